@@ -0,0 +1,663 @@
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "rtclock.h"
+#include "ts_hashmap.h"
+
+#define LF_SLOTS (1 << 20)   // buckets/slots per map in the load factor sweep
+#define MT_OPS (1 << 20)     // operations per thread in the threaded benchmarks
+#define ST_KEYS (1 << 16)    // keys in the stripes benchmark map
+#define MEM_KEYS (1 << 22)   // entries in the memory benchmark maps
+#define BATCH_KEYS 256       // keys per call in the batch benchmark
+#define HASH_SLOTS (1 << 16) // buckets in the hash benchmark map
+#define FLOOD_KEYS (1 << 12) // keys an adversary feeds the flood benchmark map
+
+// keeps lookups from being optimized away
+volatile int sink = 0;
+
+/**
+ * The i-th benchmark key. The murmur3 finalizer is a bijection on
+ * 32-bit values, so distinct i give distinct, well-scattered keys.
+ */
+static int bench_key(unsigned int i) {
+	i ^= i >> 16;
+	i *= 0x85ebca6bu;
+	i ^= i >> 13;
+	i *= 0xc2b2ae35u;
+	i ^= i >> 16;
+	return (int) i;
+}
+
+/**
+ * Times n gets of keys bench_key(base + j) for pseudo-random j < n.
+ * @return nanoseconds per get
+ */
+static double time_gets(ts_hashmap_t *m, unsigned int base, int n) {
+	unsigned int j = 0;
+	int sum = 0;
+	double start = rtclock();
+	for (int i = 0; i < n; i++) {
+		j = (j * 1103515245u + 12345u) % (unsigned int) n;
+		sum += get(m, bench_key(base + j));
+	}
+	double elapsed = rtclock() - start;
+	sink += sum;
+	return elapsed / n * 1e9;
+}
+
+/**
+ * Fills each backend to load factors 0.25..0.95 and times
+ * inserts, hits and misses. Misses use keys that were never inserted.
+ */
+static void bench_loadfactor(void) {
+	const double loads[] = { 0.25, 0.50, 0.75, 0.85, 0.90, 0.95 };
+	const ts_backend_t backends[] = { TS_CHAINED, TS_OPEN_ADDRESSING, TS_SWISS, TS_CUCKOO, TS_HOPSCOTCH };
+
+	printf("one thread; oa and swiss writers take a table-wide lock, so this shows no contention\n");
+	printf("%-10s %6s %12s %12s %12s\n", "backend", "load", "put ns/op", "hit ns/op", "miss ns/op");
+	for (int b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+		for (int l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+			ts_config_t config = { .capacity = LF_SLOTS, .backend = backends[b], .maxLoad = -1 };
+			ts_hashmap_t *m = initmap_config(&config);
+			int n = (int) (loads[l] * LF_SLOTS);
+
+			double start = rtclock();
+			for (int i = 0; i < n; i++)
+				put(m, bench_key(i), i);
+			double putNs = (rtclock() - start) / n * 1e9;
+
+			ts_stats_t stats;
+			ts_stats_snapshot(m, &stats);
+			double hitNs = time_gets(m, 0, n);
+			double missNs = time_gets(m, n, n);
+			printf("%-10s %6.2f %12.1f %12.1f %12.1f\n", ts_backend_name(backends[b]),
+					(double) stats.size / stats.capacity, putNs, hitNs, missNs);
+			freeMap(m);
+		}
+	}
+}
+
+/**
+ * Reports probe lengths and lookup cost at high load for the
+ * open-addressing layouts. Misses dominate when most keys are absent, so
+ * this is where Robin Hood's early exit should show up.
+ */
+static void bench_probe(void) {
+	const double loads[] = { 0.50, 0.75, 0.90 };
+	const ts_backend_t backends[] = { TS_CHAINED, TS_OPEN_ADDRESSING, TS_ROBIN_HOOD, TS_SWISS, TS_CUCKOO, TS_HOPSCOTCH, TS_SPLIT_ORDER, TS_EXTENDIBLE, TS_LOCK_FREE, TS_COMPACT, TS_INLINE };
+
+	printf("one thread; oa, robinhood and swiss writers take a table-wide lock, so this shows no contention\n");
+	printf("%-10s %6s %10s %10s %12s %12s\n", "backend", "load", "mean probe", "max probe", "hit ns/op", "miss ns/op");
+	for (int b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+		for (int l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+			ts_config_t config = { .capacity = LF_SLOTS, .backend = backends[b], .maxLoad = -1 };
+			ts_hashmap_t *m = initmap_config(&config);
+			int n = (int) (loads[l] * LF_SLOTS);
+			for (int i = 0; i < n; i++)
+				put(m, bench_key(i), i);
+
+			ts_stats_t stats;
+			ts_stats_snapshot(m, &stats);
+			double hitNs = time_gets(m, 0, n);
+			double missNs = time_gets(m, n, n);
+			printf("%-10s %6.2f %10.2f %10d %12.1f %12.1f\n", ts_backend_name(backends[b]),
+					(double) stats.size / stats.capacity, stats.meanProbe, stats.maxProbe, hitNs, missNs);
+			freeMap(m);
+		}
+	}
+}
+
+typedef struct mt_arg_t {
+	ts_hashmap_t *m;
+	int keys;
+	unsigned int seed;
+} mt_arg_t;
+
+/**
+ * One thread's share of a mixed workload: 90% get, 5% put and 5% del
+ * of keys bench_key(0..keys-1)
+ */
+static void *mt_worker(void *p) {
+	mt_arg_t *arg = p;
+	unsigned int r = arg->seed;
+	int sum = 0;
+	for (int i = 0; i < MT_OPS; i++) {
+		r = r * 1103515245u + 12345u;
+		int key = bench_key((r >> 8) % (unsigned int) arg->keys);
+		int op = r % 20;
+		if (op == 0)
+			sum += put(arg->m, key, i);
+		else if (op == 1)
+			sum += del(arg->m, key);
+		else
+			sum += get(arg->m, key);
+	}
+	sink += sum;
+	return NULL;
+}
+
+/**
+ * Runs mt_worker() on nthreads threads at once
+ * @return million operations per second over all threads
+ */
+static double run_threads(ts_hashmap_t *m, int nthreads, int keys) {
+	pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+	mt_arg_t *args = malloc(sizeof(mt_arg_t) * nthreads);
+	double start = rtclock();
+	for (int t = 0; t < nthreads; t++) {
+		args[t].m = m;
+		args[t].keys = keys;
+		args[t].seed = t * 7919 + 1;
+		pthread_create(&threads[t], NULL, mt_worker, &args[t]);
+	}
+	for (int t = 0; t < nthreads; t++)
+		pthread_join(threads[t], NULL);
+	double elapsed = rtclock() - start;
+	free(threads);
+	free(args);
+	return (double) nthreads * MT_OPS / elapsed / 1e6;
+}
+
+typedef struct lock_arg_t {
+	pthread_mutex_t *lock;
+	volatile int *counter;
+} lock_arg_t;
+
+static void *lock_worker(void *p) {
+	lock_arg_t *arg = p;
+	for (int i = 0; i < MT_OPS; i++) {
+		pthread_mutex_lock(arg->lock);
+		(*arg->counter)++;
+		pthread_mutex_unlock(arg->lock);
+	}
+	return NULL;
+}
+
+/**
+ * Each thread takes only its own mutex, so any slowdown of the packed
+ * array against the padded one is false sharing
+ * @return million lock/unlock pairs per second over all threads
+ */
+static double time_adjacent_locks(int nthreads, int padded) {
+	ts_stripe_t *stripes = aligned_alloc(64, sizeof(ts_stripe_t) * nthreads);
+	pthread_mutex_t *packed = malloc(sizeof(pthread_mutex_t) * nthreads);
+	int *counters = calloc(nthreads, sizeof(ts_stripe_t));
+	pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+	lock_arg_t *args = malloc(sizeof(lock_arg_t) * nthreads);
+
+	for (int t = 0; t < nthreads; t++) {
+		pthread_mutex_init(&stripes[t].lock.mutex, NULL);
+		pthread_mutex_init(&packed[t], NULL);
+	}
+	double start = rtclock();
+	for (int t = 0; t < nthreads; t++) {
+		args[t].lock = padded ? &stripes[t].lock.mutex : &packed[t];
+		args[t].counter = &counters[t * (sizeof(ts_stripe_t) / sizeof(int))];
+		pthread_create(&threads[t], NULL, lock_worker, &args[t]);
+	}
+	for (int t = 0; t < nthreads; t++)
+		pthread_join(threads[t], NULL);
+	double elapsed = rtclock() - start;
+
+	for (int t = 0; t < nthreads; t++) {
+		pthread_mutex_destroy(&stripes[t].lock.mutex);
+		pthread_mutex_destroy(&packed[t]);
+	}
+	free(stripes);
+	free(packed);
+	free(counters);
+	free(threads);
+	free(args);
+	return (double) nthreads * MT_OPS / elapsed / 1e6;
+}
+
+/**
+ * Chained map throughput and lock memory for several stripe counts,
+ * including one stripe per bucket as before stripes were configurable,
+ * plus the false sharing cost of packing mutexes next to each other
+ */
+static void bench_stripes(void) {
+	int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int nthreads = cores < 2 ? 2 : cores;
+	const int stripes[] = { ST_KEYS, 0, 4 * nthreads, nthreads };
+	const char *labels[] = { "per bucket", "default", "4 x threads", "1 x threads" };
+
+	printf("%d threads, %d buckets, 90%% get / 5%% put / 5%% del\n", nthreads, ST_KEYS);
+	printf("%-12s %8s %12s %10s\n", "stripes", "count", "lock bytes", "Mops/s");
+	for (int i = 0; i < sizeof(stripes) / sizeof(stripes[0]); i++) {
+		ts_config_t config = { .capacity = ST_KEYS, .maxLoad = -1, .minLoad = -1, .stripes = stripes[i] };
+		ts_hashmap_t *m = initmap_config(&config);
+		for (int k = 0; k < ST_KEYS / 2; k++)
+			put(m, bench_key(k), k);
+		double mops = run_threads(m, nthreads, ST_KEYS);
+		printf("%-12s %8d %12ld %10.2f\n", labels[i], m->numLocks,
+				(long) m->numLocks * sizeof(ts_stripe_t), mops);
+		freeMap(m);
+	}
+	printf("%-12s %8d %12ld %10s\n", "packed (old)", ST_KEYS, (long) ST_KEYS * sizeof(pthread_mutex_t), "-");
+
+	printf("adjacent mutexes, one per thread: packed %.2f, padded %.2f Mops/s\n",
+			time_adjacent_locks(nthreads, 0), time_adjacent_locks(nthreads, 1));
+}
+
+/**
+ * Chained map throughput for each lock policy as the thread count goes
+ * from 1 to twice the online cores. The stripe count is fixed at 16, so
+ * contention per stripe grows with the threads; past the core count,
+ * waiters also compete with preempted holders.
+ */
+static void bench_locks(void) {
+	int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+	printf("%d cores, 16 stripes, %d buckets, 90%% get / 5%% put / 5%% del\n", cores, ST_KEYS);
+	printf("%-8s", "threads");
+	for (int k = 0; k < TS_NUM_LOCKS; k++)
+		printf(" %10s", ts_lock_name(k));
+	printf("   (Mops/s)\n");
+	for (int n = 1; n <= 2 * cores; n = (n < cores && 2 * n > cores) ? cores : 2 * n) {
+		printf("%-8d", n);
+		for (int k = 0; k < TS_NUM_LOCKS; k++) {
+			ts_config_t config = { .capacity = ST_KEYS, .maxLoad = -1, .minLoad = -1, .stripes = 16, .lock = k };
+			ts_hashmap_t *m = initmap_config(&config);
+			for (int i = 0; i < ST_KEYS / 2; i++)
+				put(m, bench_key(i), i);
+			printf(" %10.2f", run_threads(m, n, ST_KEYS));
+			fflush(stdout);
+			freeMap(m);
+		}
+		printf("\n");
+	}
+}
+
+/**
+ * Chained get cost with lock-free reads kept safe by EBR or by hazard
+ * pointers, against reads that always take the stripe mutex. Times
+ * single-threaded hits, then the mixed workload from 1 to twice the
+ * online cores, and reports how many deleted nodes were left waiting to
+ * be freed after the last run.
+ */
+static void bench_reclaim(void) {
+	int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	const ts_config_t configs[] = {
+		{ .capacity = ST_KEYS, .maxLoad = -1, .minLoad = -1, .readTries = -1 },
+		{ .capacity = ST_KEYS, .maxLoad = -1, .minLoad = -1, .reclaim = TS_RECLAIM_EBR },
+		{ .capacity = ST_KEYS, .maxLoad = -1, .minLoad = -1, .reclaim = TS_RECLAIM_HAZARD },
+	};
+	const char *labels[] = { "mutex", "ebr", "hazard" };
+	int nconfigs = sizeof(configs) / sizeof(configs[0]);
+	ts_stats_t stats[sizeof(configs) / sizeof(configs[0])];
+
+	printf("%d cores, %d buckets, 90%% get / 5%% put / 5%% del\n", cores, ST_KEYS);
+	printf("%-8s", "threads");
+	for (int c = 0; c < nconfigs; c++)
+		printf(" %10s", labels[c]);
+	printf("   (Mops/s)\n");
+
+	printf("%-8s", "hit ns");
+	for (int c = 0; c < nconfigs; c++) {
+		ts_hashmap_t *m = initmap_config(&configs[c]);
+		for (int i = 0; i < ST_KEYS / 2; i++)
+			put(m, bench_key(i), i);
+		printf(" %10.1f", time_gets(m, 0, ST_KEYS / 2));
+		freeMap(m);
+	}
+	printf("\n");
+
+	for (int n = 1; n <= 2 * cores; n = (n < cores && 2 * n > cores) ? cores : 2 * n) {
+		printf("%-8d", n);
+		for (int c = 0; c < nconfigs; c++) {
+			ts_hashmap_t *m = initmap_config(&configs[c]);
+			for (int i = 0; i < ST_KEYS / 2; i++)
+				put(m, bench_key(i), i);
+			printf(" %10.2f", run_threads(m, n, ST_KEYS));
+			fflush(stdout);
+			ts_stats_snapshot(m, &stats[c]);
+			freeMap(m);
+		}
+		printf("\n");
+	}
+
+	printf("%-8s", "retired");
+	for (int c = 0; c < nconfigs; c++)
+		printf(" %10ld", stats[c].retired);
+	printf("\n%-8s", "bound");
+	for (int c = 0; c < nconfigs; c++) {
+		if (stats[c].retiredBound < 0)
+			printf(" %10s", "none");
+		else
+			printf(" %10ld", stats[c].retiredBound);
+	}
+	printf("\n");
+}
+
+/**
+ * Hit and miss cost of the chained table against the layout with each
+ * bucket's first entry inline, at fixed load factors. At low load most
+ * keys sit alone in their bucket, which inline serves in one cache miss.
+ */
+static void bench_inline(void) {
+	const double loads[] = { 0.25, 0.50, 0.75, 1.00, 2.00, 4.00, 8.00 };
+	const ts_backend_t backends[] = { TS_CHAINED, TS_INLINE };
+
+	printf("%-10s %6s %12s %12s %12s\n", "backend", "load", "steps/hit", "hit ns/op", "miss ns/op");
+	for (int l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+		for (int b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+			ts_config_t config = { .capacity = LF_SLOTS, .backend = backends[b], .maxLoad = -1, .minLoad = -1 };
+			ts_hashmap_t *m = initmap_config(&config);
+			int n = (int) (loads[l] * LF_SLOTS);
+			for (int i = 0; i < n; i++)
+				put(m, bench_key(i), i);
+
+			ts_stats_t before, after;
+			ts_stats_snapshot(m, &before);
+			double hitNs = time_gets(m, 0, n);
+			ts_stats_snapshot(m, &after);
+			double missNs = time_gets(m, n, n);
+			printf("%-10s %6.2f %12.2f %12.1f %12.1f\n", ts_backend_name(backends[b]), loads[l],
+					(double) (after.chainSteps - before.chainSteps) / n, hitNs, missNs);
+			freeMap(m);
+		}
+	}
+}
+
+/**
+ * Times n gets of pseudo-random keys bench_key(base + j), j < n, made
+ * BATCH_KEYS at a time through get_batch(), or one by one if batch is 0
+ * @return nanoseconds per key
+ */
+static double time_batch_gets(ts_hashmap_t *m, unsigned int base, int n, int batch) {
+	int keys[BATCH_KEYS];
+	int values[BATCH_KEYS];
+	unsigned int j = 0;
+	int sum = 0;
+	double elapsed = 0;
+	for (int i = 0; i < n; i += BATCH_KEYS) {
+		for (int k = 0; k < BATCH_KEYS; k++) {
+			j = (j * 1103515245u + 12345u) % (unsigned int) n;
+			keys[k] = bench_key(base + j);
+		}
+		double start = rtclock();
+		if (batch) {
+			get_batch(m, keys, values, BATCH_KEYS);
+		} else {
+			for (int k = 0; k < BATCH_KEYS; k++)
+				values[k] = get(m, keys[k]);
+		}
+		elapsed += rtclock() - start;
+		for (int k = 0; k < BATCH_KEYS; k++)
+			sum += values[k];
+	}
+	sink += sum;
+	return elapsed / n * 1e9;
+}
+
+/**
+ * Fills m with keys bench_key(0..n-1), BATCH_KEYS at a time through
+ * put_batch(), or one by one if batch is 0
+ * @return nanoseconds per key
+ */
+static double time_fill(ts_hashmap_t *m, int n, int batch) {
+	int keys[BATCH_KEYS];
+	int values[BATCH_KEYS];
+	double start = rtclock();
+	for (int i = 0; i < n; i += BATCH_KEYS) {
+		for (int k = 0; k < BATCH_KEYS; k++) {
+			keys[k] = bench_key(i + k);
+			values[k] = i + k;
+		}
+		if (batch) {
+			put_batch(m, keys, values, NULL, BATCH_KEYS);
+		} else {
+			for (int k = 0; k < BATCH_KEYS; k++)
+				put(m, keys[k], values[k]);
+		}
+	}
+	return (rtclock() - start) / n * 1e9;
+}
+
+/**
+ * Insert and lookup cost one key at a time against the batch calls, on
+ * maps of MEM_KEYS entries at load 1, far larger than the caches
+ */
+static void bench_batch(void) {
+	const ts_backend_t backends[] = { TS_CHAINED, TS_INLINE, TS_OPEN_ADDRESSING };
+
+	printf("%-10s %10s %10s %10s %10s %10s %10s   (ns/key)\n", "backend", "put", "batched",
+			"hit", "batched", "miss", "batched");
+	for (int b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+		ts_config_t config = { .capacity = MEM_KEYS, .backend = backends[b], .maxLoad = -1, .minLoad = -1 };
+		ts_hashmap_t *m = initmap_config(&config);
+		double putBatchNs = time_fill(m, MEM_KEYS, 1);
+		freeMap(m);
+
+		m = initmap_config(&config);
+		double putNs = time_fill(m, MEM_KEYS, 0);
+		double hitNs = time_batch_gets(m, 0, MEM_KEYS, 0);
+		double hitBatchNs = time_batch_gets(m, 0, MEM_KEYS, 1);
+		double missNs = time_batch_gets(m, MEM_KEYS, MEM_KEYS, 0);
+		double missBatchNs = time_batch_gets(m, MEM_KEYS, MEM_KEYS, 1);
+		printf("%-10s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", ts_backend_name(backends[b]),
+				putNs, putBatchNs, hitNs, hitBatchNs, missNs, missBatchNs);
+		freeMap(m);
+	}
+}
+
+/**
+ * The i-th key of a pattern: scattered, sequential, or a stride that is
+ * a divisor of the bucket count
+ */
+static int pattern_key(int pattern, int i) {
+	if (pattern == 0)
+		return bench_key(i);
+	if (pattern == 1)
+		return i;
+	return i * 1024;
+}
+
+/**
+ * Chained probe lengths and hit cost for each hash function on scattered,
+ * sequential and strided keys at load 0.75
+ */
+static void bench_hash(void) {
+	const char *patterns[] = { "random", "sequential", "stride" };
+	int n = HASH_SLOTS / 4 * 3;
+
+	printf("%-10s %-10s %10s %10s %10s\n", "hash", "keys", "mean probe", "max probe", "hit ns/op");
+	for (int h = 0; h < TS_NUM_HASHES; h++) {
+		for (int p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+			ts_config_t config = { .capacity = HASH_SLOTS, .maxLoad = -1, .minLoad = -1, .hash = h };
+			ts_hashmap_t *m = initmap_config(&config);
+			for (int i = 0; i < n; i++)
+				put(m, pattern_key(p, i), i);
+
+			unsigned int j = 0;
+			int sum = 0;
+			double start = rtclock();
+			for (int i = 0; i < n; i++) {
+				j = (j * 1103515245u + 12345u) % (unsigned int) n;
+				sum += get(m, pattern_key(p, j));
+			}
+			double hitNs = (rtclock() - start) / n * 1e9;
+			sink += sum;
+
+			ts_stats_t stats;
+			ts_stats_snapshot(m, &stats);
+			printf("%-10s %-10s %10.2f %10d %10.1f\n", ts_hash_name(h), patterns[p],
+					stats.meanProbe, stats.maxProbe, hitNs);
+			freeMap(m);
+		}
+	}
+}
+
+/**
+ * The i-th key of a hostile stream: scattered keys as a baseline, then
+ * multiples of 2^20, which share bucket 0 under key % capacity, then
+ * murmur3 preimages of 0..n-1, whose hashes all have twenty leading
+ * zeros and so share bucket 0 of (hash * capacity) >> 32. Both hold for
+ * every capacity up to 2^20.
+ */
+static int flood_key(int stream, int i) {
+	if (stream == 0)
+		return bench_key(i);
+	if (stream == 1)
+		return i << 20;
+
+	unsigned int h = i; // the murmur3 finalizer, inverted step by step
+	h ^= h >> 16;
+	h *= 0x7ed1b41du;
+	h ^= (h >> 13) ^ (h >> 26);
+	h *= 0xa5cb9243u;
+	h ^= h >> 16;
+	return (int) h;
+}
+
+/**
+ * Insert and hit cost per hash function when an adversary picks the
+ * keys, on a map that starts small and grows as usual
+ */
+static void bench_flood(void) {
+	const char *streams[] = { "random", "stride", "murmur" };
+
+	printf("%-10s %-10s %10s %10s %10s %10s\n", "hash", "keys", "put ns/op", "hit ns/op",
+			"max probe", "reseeds");
+	for (int h = 0; h < TS_NUM_HASHES; h++) {
+		for (int s = 0; s < sizeof(streams) / sizeof(streams[0]); s++) {
+			ts_config_t config = { .capacity = 1024, .hash = h };
+			ts_hashmap_t *m = initmap_config(&config);
+			double start = rtclock();
+			for (int i = 0; i < FLOOD_KEYS; i++)
+				put(m, flood_key(s, i), i);
+			double putNs = (rtclock() - start) / FLOOD_KEYS * 1e9;
+
+			int sum = 0;
+			start = rtclock();
+			for (int i = 0; i < FLOOD_KEYS; i++)
+				sum += get(m, flood_key(s, i));
+			double hitNs = (rtclock() - start) / FLOOD_KEYS * 1e9;
+			sink += sum;
+
+			ts_stats_t stats;
+			ts_stats_snapshot(m, &stats);
+			printf("%-10s %-10s %10.1f %10.1f %10d %10ld\n", ts_hash_name(h), streams[s],
+					putNs, hitNs, stats.maxProbe, stats.reseeds);
+			freeMap(m);
+		}
+	}
+}
+
+/**
+ * Insert and hit cost of the chained table under identity hashing, with
+ * stride keys all landing in one bucket, as chains and as a tree
+ */
+static void bench_tree(void) {
+	const int counts[] = { 64, 256, 1024, FLOOD_KEYS };
+	const int treeify[] = { -1, 0 };
+
+	printf("%-10s %10s %10s %10s %10s\n", "bucket", "keys", "put ns/op", "hit ns/op", "max probe");
+	for (int t = 0; t < sizeof(treeify) / sizeof(treeify[0]); t++) {
+		for (int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+			ts_config_t config = { .capacity = 1024, .treeify = treeify[t] };
+			ts_hashmap_t *m = initmap_config(&config);
+			double start = rtclock();
+			for (int i = 0; i < counts[c]; i++)
+				put(m, flood_key(1, i), i);
+			double putNs = (rtclock() - start) / counts[c] * 1e9;
+
+			int sum = 0;
+			start = rtclock();
+			for (int i = 0; i < counts[c]; i++)
+				sum += get(m, flood_key(1, i));
+			double hitNs = (rtclock() - start) / counts[c] * 1e9;
+			sink += sum;
+
+			ts_stats_t stats;
+			ts_stats_snapshot(m, &stats);
+			printf("%-10s %10d %10.1f %10.1f %10d\n", stats.trees > 0 ? "tree" : "chain", counts[c],
+					putNs, hitNs, stats.maxProbe);
+			freeMap(m);
+		}
+	}
+}
+
+/**
+ * Bytes the program has allocated and not freed, per glibc
+ */
+static long heap_in_use(void) {
+	struct mallinfo2 info = mallinfo2();
+	return (long) (info.uordblks + info.hblkhd);
+}
+
+/**
+ * Heap bytes per entry and hit cost of the chained layouts, grown from a
+ * small map to MEM_KEYS entries at their default load limits
+ */
+static void bench_memory(void) {
+	const ts_backend_t backends[] = { TS_CHAINED, TS_COMPACT };
+
+	printf("%-10s %10s %10s %12s %12s\n", "backend", "entries", "capacity", "bytes/entry", "hit ns/op");
+	for (int b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+		long before = heap_in_use();
+		ts_config_t config = { .capacity = 1024, .backend = backends[b] };
+		ts_hashmap_t *m = initmap_config(&config);
+		for (int i = 0; i < MEM_KEYS; i++)
+			put(m, bench_key(i), i);
+		double hitNs = time_gets(m, 0, MEM_KEYS);
+		long bytes = heap_in_use() - before;
+
+		ts_stats_t stats;
+		ts_stats_snapshot(m, &stats);
+		printf("%-10s %10d %10d %12.1f %12.1f\n", ts_backend_name(backends[b]), stats.size,
+				stats.capacity, (double) bytes / stats.size, hitNs);
+		freeMap(m);
+	}
+}
+
+typedef struct bench_t {
+	const char *name;
+	void (*run)(void);
+} bench_t;
+
+static const bench_t benches[] = {
+	{ "loadfactor", bench_loadfactor },
+	{ "probe", bench_probe },
+	{ "stripes", bench_stripes },
+	{ "locks", bench_locks },
+	{ "reclaim", bench_reclaim },
+	{ "memory", bench_memory },
+	{ "inline", bench_inline },
+	{ "batch", bench_batch },
+	{ "hash", bench_hash },
+	{ "flood", bench_flood },
+	{ "tree", bench_tree },
+};
+
+/**
+ * Runs the named benchmarks, or all of them when none are named
+ */
+int main(int argc, char *argv[]) {
+	int nbench = sizeof(benches) / sizeof(benches[0]);
+	for (int a = 1; a < argc; a++) {
+		int known = 0;
+		for (int i = 0; i < nbench; i++)
+			known |= (strcmp(argv[a], benches[i].name) == 0);
+		if (!known) {
+			printf("Unknown benchmark: %s\n", argv[a]);
+			return 1;
+		}
+	}
+
+	for (int i = 0; i < nbench; i++) {
+		int selected = (argc < 2);
+		for (int a = 1; a < argc; a++)
+			selected |= (strcmp(argv[a], benches[i].name) == 0);
+		if (selected) {
+			printf("== %s ==\n", benches[i].name);
+			benches[i].run();
+		}
+	}
+	return 0;
+}
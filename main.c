@@ -35,7 +35,13 @@ void* threadwork(void* args) {
  */
 int main(int argc, char *argv[]) {
 	if (argc < 4) {
-		printf("Usage: %s <num threads> <hashmap capacity> <max key>\n", argv[0]);
+		printf("Usage: %s <num threads> <hashmap capacity> <max key> [backend]\n", argv[0]);
+		return 1;
+	}
+
+	ts_config_t config = { 0 };
+	if (argc > 4 && ts_backend_parse(argv[4], &config.backend) != 0) {
+		printf("Unknown backend: %s\n", argv[4]);
 		return 1;
 	}
 
@@ -46,7 +52,8 @@ int main(int argc, char *argv[]) {
 	maxKey = (unsigned int) atoi(argv[3]);
 
 	// initialize map
-	map = initmap(capacity);
+	config.capacity = capacity;
+	map = initmap_config(&config);
 
 	// start clocking!
 	startTime = rtclock();
@@ -70,8 +77,10 @@ int main(int argc, char *argv[]) {
 	// print content and timing results
 	// UNCOMMENT BELOW FOR DEBUGGING
 	//printmap(map);
-	printf("Number of ops = %d, time elapsed = %.6f sec\n", map->numOps, (endTime-startTime));
-	printf("Time per op   = %.6f ms\n", (double)(endTime-startTime)/map->numOps*1000);
+	ts_stats_t stats;
+	ts_stats_snapshot(map, &stats);
+	printf("Number of ops = %ld, time elapsed = %.6f sec\n", stats.numOps, (endTime-startTime));
+	printf("Time per op   = %.6f ms\n", (double)(endTime-startTime)/stats.numOps*1000);
 	freeMap(map);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,501 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ts_hashmap.h"
+
+#define TEST_THREADS 4
+#define TEST_OWNED 512        // keys each thread of test_owned() owns
+#define TEST_OPS 8000         // operations per thread of test_owned()
+#define TEST_STABLE 1000      // keys readers of test_resize() expect to find
+#define TEST_CHURN 4000       // keys each writer of test_resize() adds and removes
+#define TEST_ROUNDS 3         // times each writer of test_resize() does so
+#define TEST_BATCH 32         // keys per batch call of the threaded tests
+#define TEST_MAX_REPORTS 10   // failures printed before the rest are only counted
+
+static int failures = 0;
+
+// TSan's deadlock detector aborts a thread that holds more than 64
+// mutexes at once, as cuckoo and hopscotch grows do; a build without TSan
+// never calls this
+const char *__tsan_default_options(void) {
+	return "detect_deadlocks=0";
+}
+
+/**
+ * Counts a failed check and prints the first few
+ */
+static void fail(const char *test, const char *what, int key, int got, int want) {
+	if (__atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED) < TEST_MAX_REPORTS)
+		printf("FAIL %s: %s key %d got %d want %d\n", test, what, key, got, want);
+}
+
+static void expect(const char *test, const char *what, int key, int got, int want) {
+	if (got != want)
+		fail(test, what, key, got, want);
+}
+
+/**
+ * A name for a configuration, for failure reports
+ */
+static const char *config_name(const ts_config_t *config, char *buf, size_t size) {
+	if (config->backend != TS_CHAINED)
+		snprintf(buf, size, "%s%s", ts_backend_name(config->backend), config->stripes == 1 ? "/1 stripe" : "");
+	else
+		snprintf(buf, size, "chained/%s/%s/%s", ts_hash_name(config->hash), ts_lock_name(config->lock),
+				config->reclaim == TS_RECLAIM_HAZARD ? "hazard" : "ebr");
+	return buf;
+}
+
+/**
+ * The map's size as ts_stats_snapshot() reports it, checked against want
+ */
+static void expect_size(const char *test, ts_hashmap_t *m, int want) {
+	ts_stats_t stats;
+	ts_stats_snapshot(m, &stats);
+	expect(test, "size", -1, stats.size, want);
+	if (stats.retiredBound >= 0 && stats.retired > stats.retiredBound)
+		fail(test, "retired past bound", -1, (int) stats.retired, (int) stats.retiredBound);
+}
+
+/**
+ * put, get and del from one thread, including negative keys and the
+ * INT_MIN key open addressing keeps apart from its slots
+ */
+static void test_sequential(const ts_config_t *base) {
+	char name[64];
+	config_name(base, name, sizeof(name));
+	ts_config_t config = *base;
+	config.capacity = 4;
+	ts_hashmap_t *m = initmap_config(&config);
+	const int n = 1000;
+
+	for (int k = -n; k < n; k++)
+		expect(name, "put new", k, put(m, k, k * 2), INT_MAX);
+	expect(name, "put new", INT_MIN, put(m, INT_MIN, 7), INT_MAX);
+	for (int k = -n; k < n; k++)
+		expect(name, "put old", k, put(m, k, k * 3), k * 2);
+	expect_size(name, m, 2 * n + 1);
+
+	for (int k = -n; k < n; k += 2)
+		expect(name, "del", k, del(m, k), k * 3);
+	expect(name, "del", INT_MIN, del(m, INT_MIN), 7);
+	for (int k = -n; k < n; k++)
+		expect(name, "get", k, get(m, k), (k - n) % 2 == 0 ? INT_MAX : k * 3);
+	expect(name, "get", INT_MIN, get(m, INT_MIN), INT_MAX);
+	expect(name, "del missing", 0, del(m, 0), INT_MAX);
+	expect_size(name, m, n);
+	freeMap(m);
+}
+
+/**
+ * The batch calls against the same puts and dels one at a time, with
+ * batches longer than a chained write chunk and repeated keys
+ */
+static void test_batch(const ts_config_t *base) {
+	char name[64];
+	config_name(base, name, sizeof(name));
+	ts_config_t config = *base;
+	config.capacity = 8;
+	ts_hashmap_t *batched = initmap_config(&config);
+	ts_hashmap_t *single = initmap_config(&config);
+	const int n = 3000;
+	int *keys = malloc(sizeof(int) * n);
+	int *values = malloc(sizeof(int) * n);
+	int *old = malloc(sizeof(int) * n);
+	unsigned int r = 1;
+
+	for (int round = 0; round < 8; round++) {
+		for (int i = 0; i < n; i++) {
+			r = r * 1103515245u + 12345u;
+			keys[i] = (r >> 8) % 2000;
+			values[i] = round * n + i;
+		}
+		put_batch(batched, keys, values, old, n);
+		for (int i = 0; i < n; i++)
+			expect(name, "put_batch", keys[i], old[i], put(single, keys[i], values[i]));
+
+		for (int i = 0; i < n; i++) {
+			r = r * 1103515245u + 12345u;
+			keys[i] = (r >> 8) % 2000;
+		}
+		del_batch(batched, keys, old, n / 3);
+		for (int i = 0; i < n / 3; i++)
+			expect(name, "del_batch", keys[i], old[i], del(single, keys[i]));
+
+		get_batch(batched, keys, old, n);
+		for (int i = 0; i < n; i++)
+			expect(name, "get_batch", keys[i], old[i], get(single, keys[i]));
+	}
+	free(keys);
+	free(values);
+	free(old);
+	freeMap(batched);
+	freeMap(single);
+}
+
+typedef struct owned_arg_t {
+	ts_hashmap_t *m;
+	const char *name;
+	int thread;
+	int present;          // keys the thread left in the map
+} owned_arg_t;
+
+/**
+ * Random puts, gets, dels and batches on keys only this thread writes,
+ * interleaved with the other threads' keys so they share buckets. A
+ * local copy says what every call must return.
+ */
+static void *owned_worker(void *p) {
+	owned_arg_t *arg = p;
+	int *shadow = malloc(sizeof(int) * TEST_OWNED);
+	int keys[TEST_BATCH], values[TEST_BATCH], old[TEST_BATCH];
+	unsigned int r = arg->thread * 7919 + 1;
+
+	for (int i = 0; i < TEST_OWNED; i++)
+		shadow[i] = INT_MAX;
+	for (int op = 0; op < TEST_OPS; op++) {
+		r = r * 1103515245u + 12345u;
+		int slot = (r >> 8) % TEST_OWNED;
+		int key = slot * TEST_THREADS + arg->thread;
+		switch (r % 16) {
+		case 0: case 1: case 2: case 3: case 4:
+			expect(arg->name, "put", key, put(arg->m, key, op), shadow[slot]);
+			shadow[slot] = op;
+			break;
+		case 5: case 6: case 7:
+			expect(arg->name, "del", key, del(arg->m, key), shadow[slot]);
+			shadow[slot] = INT_MAX;
+			break;
+		case 8:
+		case 9:
+			for (int i = 0; i < TEST_BATCH; i++) {
+				r = r * 1103515245u + 12345u;
+				keys[i] = (r >> 8) % TEST_OWNED;
+				values[i] = op;
+			}
+			for (int i = 0; i < TEST_BATCH; i++)
+				keys[i] = keys[i] * TEST_THREADS + arg->thread;
+			if (r % 16 == 8) {
+				put_batch(arg->m, keys, values, old, TEST_BATCH);
+			} else {
+				del_batch(arg->m, keys, old, TEST_BATCH);
+			}
+			for (int i = 0; i < TEST_BATCH; i++) {
+				int s = keys[i] / TEST_THREADS;
+				expect(arg->name, r % 16 == 8 ? "put_batch" : "del_batch", keys[i], old[i], shadow[s]);
+				shadow[s] = (r % 16 == 8) ? values[i] : INT_MAX;
+			}
+			break;
+		default:
+			expect(arg->name, "get", key, get(arg->m, key), shadow[slot]);
+			break;
+		}
+	}
+
+	arg->present = 0;
+	for (int i = 0; i < TEST_OWNED; i++) {
+		expect(arg->name, "final get", i * TEST_THREADS + arg->thread,
+				get(arg->m, i * TEST_THREADS + arg->thread), shadow[i]);
+		arg->present += (shadow[i] != INT_MAX);
+	}
+	free(shadow);
+	return NULL;
+}
+
+/**
+ * TEST_THREADS threads at once on a map that starts too small, so it
+ * grows while they run; every result is checked
+ */
+static void test_owned(const ts_config_t *base) {
+	char name[64];
+	config_name(base, name, sizeof(name));
+	ts_config_t config = *base;
+	config.capacity = 4;
+	ts_hashmap_t *m = initmap_config(&config);
+	pthread_t threads[TEST_THREADS];
+	owned_arg_t args[TEST_THREADS];
+
+	for (int t = 0; t < TEST_THREADS; t++) {
+		args[t] = (owned_arg_t) { .m = m, .name = name, .thread = t };
+		pthread_create(&threads[t], NULL, owned_worker, &args[t]);
+	}
+	int present = 0;
+	for (int t = 0; t < TEST_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+		present += args[t].present;
+	}
+	expect_size(name, m, present);
+	freeMap(m);
+}
+
+typedef struct resize_arg_t {
+	ts_hashmap_t *m;
+	const char *name;
+	int thread;
+	int maxCapacity;      // largest capacity a writer saw
+	volatile int *done;
+} resize_arg_t;
+
+/**
+ * Looks up the stable keys, one at a time and in batches, until the
+ * writers are done; each must be there with its value throughout
+ */
+static void *resize_reader(void *p) {
+	resize_arg_t *arg = p;
+	int keys[TEST_BATCH], values[TEST_BATCH];
+	while (!__atomic_load_n(arg->done, __ATOMIC_ACQUIRE)) {
+		for (int k = 0; k < TEST_STABLE; k++)
+			expect(arg->name, "stable get", k, get(arg->m, k), k * 3 + 1);
+		for (int k = 0; k + TEST_BATCH <= TEST_STABLE; k += TEST_BATCH) {
+			for (int i = 0; i < TEST_BATCH; i++)
+				keys[i] = k + i;
+			get_batch(arg->m, keys, values, TEST_BATCH);
+			for (int i = 0; i < TEST_BATCH; i++)
+				expect(arg->name, "stable get_batch", keys[i], values[i], keys[i] * 3 + 1);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Fills the map well past its capacity with keys of its own and empties
+ * it again, rewriting the stable keys with the values they already have
+ */
+static void *resize_writer(void *p) {
+	resize_arg_t *arg = p;
+	int first = (arg->thread + 1) * 1000000;
+	for (int round = 0; round < TEST_ROUNDS; round++) {
+		for (int i = 0; i < TEST_CHURN; i++) {
+			expect(arg->name, "churn put", first + i, put(arg->m, first + i, i), INT_MAX);
+			if (i % 8 == 0) {
+				int k = (i / 8) % TEST_STABLE;
+				expect(arg->name, "stable put", k, put(arg->m, k, k * 3 + 1), k * 3 + 1);
+			}
+		}
+		int capacity = __atomic_load_n(&arg->m->capacity, __ATOMIC_RELAXED);
+		if (capacity > arg->maxCapacity)
+			arg->maxCapacity = capacity;
+		for (int i = 0; i < TEST_CHURN; i++)
+			expect(arg->name, "churn del", first + i, del(arg->m, first + i), i);
+	}
+	return NULL;
+}
+
+/**
+ * Two readers look up keys that never change while two writers grow the
+ * map several times over and, where the backend shrinks, shrink it back
+ */
+static void test_resize(const ts_config_t *base) {
+	char name[64];
+	config_name(base, name, sizeof(name));
+	ts_config_t config = *base;
+	config.capacity = 64;
+	ts_hashmap_t *m = initmap_config(&config);
+	int initialCapacity = m->capacity;
+	volatile int done = 0;
+	pthread_t threads[TEST_THREADS];
+	resize_arg_t args[TEST_THREADS];
+
+	for (int k = 0; k < TEST_STABLE; k++)
+		put(m, k, k * 3 + 1);
+	for (int t = 0; t < TEST_THREADS; t++) {
+		args[t] = (resize_arg_t) { .m = m, .name = name, .thread = t, .done = &done };
+		pthread_create(&threads[t], NULL, t < TEST_THREADS / 2 ? resize_writer : resize_reader, &args[t]);
+	}
+	int maxCapacity = 0;
+	for (int t = 0; t < TEST_THREADS / 2; t++) {
+		pthread_join(threads[t], NULL);
+		if (args[t].maxCapacity > maxCapacity)
+			maxCapacity = args[t].maxCapacity;
+	}
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	for (int t = TEST_THREADS / 2; t < TEST_THREADS; t++)
+		pthread_join(threads[t], NULL);
+
+	// lockfree keeps the bucket count it started with
+	if (config.backend != TS_LOCK_FREE && maxCapacity <= initialCapacity)
+		fail(name, "never grew", -1, maxCapacity, initialCapacity);
+	for (int k = 0; k < TEST_STABLE; k++)
+		expect(name, "final get", k, get(m, k), k * 3 + 1);
+	expect_size(name, m, TEST_STABLE);
+	freeMap(m);
+}
+
+typedef struct tree_arg_t {
+	ts_hashmap_t *m;
+	const char *name;
+	int thread;
+	volatile int *done;
+} tree_arg_t;
+
+static void *tree_writer(void *p) {
+	tree_arg_t *arg = p;
+	for (int round = 0; round < 200; round++) {
+		for (int i = 0; i < 40; i++) {
+			int key = (1000 + arg->thread * 100 + i) * 64;
+			expect(arg->name, "tree put", key, put(arg->m, key, i), INT_MAX);
+		}
+		for (int i = 0; i < 40; i++) {
+			int key = (1000 + arg->thread * 100 + i) * 64;
+			expect(arg->name, "tree del", key, del(arg->m, key), i);
+		}
+	}
+	return NULL;
+}
+
+static void *tree_reader(void *p) {
+	tree_arg_t *arg = p;
+	while (!__atomic_load_n(arg->done, __ATOMIC_ACQUIRE)) {
+		for (int k = 0; k < 200; k++)
+			expect(arg->name, "tree get", k * 64, get(arg->m, k * 64), k);
+	}
+	return NULL;
+}
+
+/**
+ * Every key in one bucket of the chained table, so that it turns into a
+ * tree, with readers on it while writers add and remove more of its keys;
+ * emptied, it turns back into a chain
+ */
+static void test_tree(ts_reclaim_t reclaim) {
+	ts_config_t config = { .capacity = 64, .stripes = 4, .maxLoad = -1, .reclaim = reclaim };
+	char base[64], name[72];
+	snprintf(name, sizeof(name), "%s/tree", config_name(&config, base, sizeof(base)));
+	ts_hashmap_t *m = initmap_config(&config);
+	volatile int done = 0;
+	pthread_t threads[TEST_THREADS];
+	tree_arg_t args[TEST_THREADS];
+	ts_stats_t stats;
+
+	for (int k = 0; k < 200; k++)
+		put(m, k * 64, k);
+	ts_stats_snapshot(m, &stats);
+	if (stats.trees == 0)
+		fail(name, "no tree", 0, stats.trees, 1);
+
+	for (int t = 0; t < TEST_THREADS; t++) {
+		args[t] = (tree_arg_t) { .m = m, .name = name, .thread = t, .done = &done };
+		pthread_create(&threads[t], NULL, t < TEST_THREADS / 2 ? tree_writer : tree_reader, &args[t]);
+	}
+	for (int t = 0; t < TEST_THREADS / 2; t++)
+		pthread_join(threads[t], NULL);
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	for (int t = TEST_THREADS / 2; t < TEST_THREADS; t++)
+		pthread_join(threads[t], NULL);
+
+	for (int k = 0; k < 200; k++)
+		expect(name, "del", k * 64, del(m, k * 64), k);
+	ts_stats_snapshot(m, &stats);
+	expect(name, "trees left", 0, stats.trees, 0);
+	expect(name, "size", -1, stats.size, 0);
+	freeMap(m);
+}
+
+typedef struct reseed_arg_t {
+	ts_hashmap_t *m;
+	const int *keys;
+	volatile int *done;
+} reseed_arg_t;
+
+static void *reseed_reader(void *p) {
+	reseed_arg_t *arg = p;
+	while (!__atomic_load_n(arg->done, __ATOMIC_ACQUIRE)) {
+		for (int i = 0; i < 100; i++) {
+			int v = get(arg->m, arg->keys[i]);
+			if (v != INT_MAX && v != i)
+				fail("chained/siphash/reseed", "get", arg->keys[i], v, i);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * With one bucket per stripe, keys whose SipHash picks the same stripe
+ * share a chain, so a put onto it sets off a reseed. Readers must find
+ * the keys through the rehashes that follow.
+ */
+static void test_reseed(ts_reclaim_t reclaim) {
+	ts_config_t config = { .capacity = 64, .stripes = 64, .maxLoad = -1, .treeify = -1,
+		.hash = TS_HASH_SIPHASH, .reclaim = reclaim };
+	ts_hashmap_t *m = initmap_config(&config);
+	int keys[100];
+	volatile int done = 0;
+	pthread_t threads[2];
+	reseed_arg_t arg = { .m = m, .keys = keys, .done = &done };
+	ts_stats_t stats;
+
+	unsigned int target = ts_fastrange(ts_siphash(m->secret, 0) >> 32, m->numLocks);
+	for (int k = 0, n = 0; n < 100; k++) {
+		if (ts_fastrange(ts_siphash(m->secret, k) >> 32, m->numLocks) == target)
+			keys[n++] = k;
+	}
+	for (int t = 0; t < 2; t++)
+		pthread_create(&threads[t], NULL, reseed_reader, &arg);
+	for (int i = 0; i < 100; i++)
+		expect("chained/siphash/reseed", "put", keys[i], put(m, keys[i], i), INT_MAX);
+	for (int i = 0; i < 1000; i++) // Drive the migrations to the end
+		put(m, 1000000 + i, i);
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	for (int t = 0; t < 2; t++)
+		pthread_join(threads[t], NULL);
+
+	ts_stats_snapshot(m, &stats);
+	if (stats.reseeds == 0)
+		fail("chained/siphash/reseed", "no reseed", -1, 0, 1);
+	for (int i = 0; i < 100; i++)
+		expect("chained/siphash/reseed", "final get", keys[i], get(m, keys[i]), i);
+	expect_size("chained/siphash/reseed", m, 1100);
+	freeMap(m);
+}
+
+// Every test of main() runs on each of these
+static const ts_config_t configs[] = {
+	{ .backend = TS_CHAINED },
+	{ .backend = TS_OPEN_ADDRESSING },
+	{ .backend = TS_ROBIN_HOOD },
+	{ .backend = TS_SWISS },
+	{ .backend = TS_CUCKOO },
+	{ .backend = TS_HOPSCOTCH },
+	{ .backend = TS_SPLIT_ORDER },
+	{ .backend = TS_EXTENDIBLE },
+	{ .backend = TS_LOCK_FREE },
+	{ .backend = TS_COMPACT },
+	{ .backend = TS_INLINE },
+	{ .backend = TS_INLINE, .stripes = 1 }, // every get races every grow
+	{ .reclaim = TS_RECLAIM_HAZARD },
+	{ .hash = TS_HASH_SIPHASH },
+	{ .hash = TS_HASH_MURMUR, .lock = TS_LOCK_TTAS },
+	{ .hash = TS_HASH_WYHASH, .lock = TS_LOCK_TICKET,
+		.reclaim = TS_RECLAIM_HAZARD },
+	{ .hash = TS_HASH_FIBONACCI, .lock = TS_LOCK_MCS },
+};
+
+/**
+ * Runs every test on every configuration
+ * @return 0 if every check passed
+ */
+int main(void) {
+	for (int c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+		char name[64];
+		int before = failures;
+		test_sequential(&configs[c]);
+		test_batch(&configs[c]);
+		test_owned(&configs[c]);
+		test_resize(&configs[c]);
+		printf("%-4s %s\n", failures == before ? "ok" : "FAIL", config_name(&configs[c], name, sizeof(name)));
+	}
+	for (int r = 0; r < TS_NUM_RECLAIMS; r++) {
+		int before = failures;
+		test_tree(r);
+		test_reseed(r);
+		printf("%-4s chained tree and reseed, %s\n", failures == before ? "ok" : "FAIL",
+				r == TS_RECLAIM_HAZARD ? "hazard" : "ebr");
+	}
+
+	if (failures > 0) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
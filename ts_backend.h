@@ -0,0 +1,68 @@
+#ifndef TS_BACKEND_H_
+#define TS_BACKEND_H_
+
+#include <limits.h>
+#include "ts_hashmap.h"
+
+// Operations of a storage layout other than the chained table.
+// initmap_config() installs one in map->ops; the public
+// get/put/del/printmap/freeMap forward to it, and the batch calls run
+// prefetch, if set, ahead of each group of keys. init() sets up map->impl
+// and returns 0, or -1 if it could not allocate.
+typedef struct ts_ops_t {
+   int (*init)(ts_hashmap_t*, const ts_config_t*);
+   int (*get)(ts_hashmap_t*, int);
+   int (*put)(ts_hashmap_t*, int, int);
+   int (*del)(ts_hashmap_t*, int);
+   void (*print)(ts_hashmap_t*);
+   void (*free)(ts_hashmap_t*);
+   void (*stats)(ts_hashmap_t*, ts_stats_t*);   // fills the probe fields
+   void (*prefetch)(ts_hashmap_t*, int);        // optional: starts loading key's bucket
+} ts_ops_t;
+
+// Summing the size reads every counter shard, so backends that grow by
+// their load check it only every TS_LOAD_CHECK writes of a thread
+#define TS_LOAD_CHECK 8
+
+extern __thread int ts_shard_self;
+int ts_shard_assign(void);
+long ts_count_size(ts_hashmap_t*);
+
+/**
+ * The calling thread's shard of map's counters
+ */
+static inline ts_counters_t *ts_counters(ts_hashmap_t *map)
+{
+  int shard = ts_shard_self;
+  if (shard < 0)
+    shard = ts_shard_assign();
+  return &map->counters[shard & (map->numCounters - 1)];
+}
+
+// Adds one to a field of the calling thread's counter shard
+#define TS_COUNT(map, field) \
+  __atomic_fetch_add(&ts_counters(map)->field, 1, __ATOMIC_RELAXED)
+
+/**
+ * Counts a finished get() as a hit or a miss by what it returns
+ */
+static inline void ts_count_get(ts_hashmap_t *map, int value)
+{
+  if (value != INT_MAX)
+    TS_COUNT(map, hits);
+  else
+    TS_COUNT(map, misses);
+}
+
+extern const ts_ops_t ts_oa_ops;
+extern const ts_ops_t ts_rh_ops;
+extern const ts_ops_t ts_swiss_ops;
+extern const ts_ops_t ts_cuckoo_ops;
+extern const ts_ops_t ts_hopscotch_ops;
+extern const ts_ops_t ts_splitorder_ops;
+extern const ts_ops_t ts_extendible_ops;
+extern const ts_ops_t ts_lockfree_ops;
+extern const ts_ops_t ts_compact_ops;
+extern const ts_ops_t ts_inline_ops;
+
+#endif /* TS_BACKEND_H_ */
@@ -0,0 +1,377 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ts_backend.h"
+
+#define CP_NIL 0              // index 0 is never handed out, so it ends chains
+#define CP_CHUNK_BITS 16      // entries per chunk: 64Ki, 768 KiB
+#define CP_CHUNKS (1u << (32 - CP_CHUNK_BITS))
+#define CP_MAX_LOAD 1.0       // default entries per bucket before growing
+#define CP_STRIPES_PER_CORE 4
+#define CP_MAX_CAPACITY (1u << 30)
+
+// The chained layout with 32-bit indices for links. An entry is 12 bytes
+// and a bucket head 4, against 16 and 8 for ts_entry_t and its pointer,
+// and entries sit back to back in large chunks, so a chain walk stays
+// within far fewer pages.
+typedef struct cp_entry_t {
+  int key;
+  int value;
+  unsigned int next;          // index of the next entry, or CP_NIL
+} cp_entry_t;
+
+// A lock stripe, padded so that no two stripes share a cache line. It
+// keeps the bucket array its buckets are in, which differs from other
+// stripes' only while the table grows, and the entries its writers
+// deleted, for its writers to reuse.
+typedef struct cp_stripe_t {
+  ts_lock_t lock;
+  unsigned int *buckets;
+  unsigned int capacity;
+  unsigned int freeList;      // linked through next
+} __attribute__((aligned(64))) cp_stripe_t;
+
+// Entry i lives in chunks[i >> CP_CHUNK_BITS], installed by CAS when the
+// bump index first reaches it, so the pool grows without moving an entry
+// and wastes at most part of its last chunk. The directory has room for
+// every 32-bit index; only the pages of it in use are ever touched.
+// Bucket b and every entry in it are guarded by stripes[b % numStripes];
+// the capacity stays a multiple of numStripes, so that is also the
+// stripe of the key, and doubling moves a bucket's entries only between
+// buckets of the same stripe. Growing thus relinks one stripe at a time
+// into the new array, never holding two stripe locks.
+typedef struct cp_table_t {
+  unsigned int *buckets;      // changed only under growLock
+  unsigned int capacity;
+  pthread_mutex_t growLock;
+  unsigned int bump;          // next index never handed out
+  cp_entry_t **chunks;
+  cp_stripe_t *stripes;
+  int numStripes;
+  ts_lock_kind_t lockKind;
+  double maxLoad;
+} cp_table_t;
+
+static __thread unsigned int writesSinceCheck = 0;
+
+/**
+ * The entry at index i, which must have been handed out
+ */
+static inline cp_entry_t *cp_at(cp_table_t *t, unsigned int i)
+{
+  cp_entry_t *chunk = __atomic_load_n(&t->chunks[i >> CP_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  return &chunk[i & ((1u << CP_CHUNK_BITS) - 1)];
+}
+
+/**
+ * Hands out an entry index for a writer holding stripe s: one its
+ * stripe freed earlier, else the next never used, installing its chunk
+ * if it is the first there.
+ * @return the index, or CP_NIL if out of memory or out of indices
+ */
+static unsigned int cp_alloc(cp_table_t *t, cp_stripe_t *s)
+{
+  unsigned int i = s->freeList;
+  if (i != CP_NIL)
+  {
+    s->freeList = cp_at(t, i)->next;
+    return i;
+  }
+
+  i = __atomic_load_n(&t->bump, __ATOMIC_RELAXED);
+  do
+  {
+    if (i == UINT_MAX)
+      return CP_NIL;
+  } while (!__atomic_compare_exchange_n(&t->bump, &i, i + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  cp_entry_t **slot = &t->chunks[i >> CP_CHUNK_BITS];
+  if (__atomic_load_n(slot, __ATOMIC_ACQUIRE) == NULL)
+  {
+    cp_entry_t *fresh = malloc(sizeof(cp_entry_t) << CP_CHUNK_BITS);
+    cp_entry_t *expected = NULL;
+    if (fresh == NULL)
+      return CP_NIL;
+    if (!__atomic_compare_exchange_n(slot, &expected, fresh, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+      free(fresh); // Another thread installed it first
+  }
+  return i;
+}
+
+static int cp_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  cp_table_t *t = calloc(1, sizeof(cp_table_t));
+  long stripes = config->stripes > 0 ? config->stripes : CP_STRIPES_PER_CORE * sysconf(_SC_NPROCESSORS_ONLN);
+  long capacity = map->capacity;
+
+  if (stripes < 1 || stripes > capacity)
+    stripes = capacity;
+  capacity = (capacity + stripes - 1) / stripes * stripes;
+  if (t == NULL || capacity > CP_MAX_CAPACITY ||
+      (t->chunks = calloc(CP_CHUNKS, sizeof(cp_entry_t *))) == NULL ||
+      (t->buckets = calloc(capacity, sizeof(unsigned int))) == NULL ||
+      (t->stripes = aligned_alloc(64, sizeof(cp_stripe_t) * stripes)) == NULL)
+  {
+    if (t != NULL)
+    {
+      free(t->chunks);
+      free(t->buckets);
+    }
+    free(t);
+    return -1;
+  }
+
+  for (int i = 0; i < stripes; i++)
+  {
+    ts_lock_init(&t->stripes[i].lock, config->lock);
+    t->stripes[i].buckets = t->buckets;
+    t->stripes[i].capacity = capacity;
+    t->stripes[i].freeList = CP_NIL;
+  }
+  pthread_mutex_init(&t->growLock, NULL);
+  t->capacity = capacity;
+  t->bump = 1;
+  t->numStripes = stripes;
+  t->lockKind = config->lock;
+  t->maxLoad = config->maxLoad != 0 ? config->maxLoad : CP_MAX_LOAD;
+  map->impl = t;
+  map->capacity = capacity;
+  return 0;
+}
+
+static inline cp_stripe_t *cp_stripe(cp_table_t *t, int key)
+{
+  return &t->stripes[((unsigned int)key) % t->numStripes];
+}
+
+/**
+ * Finds key in its bucket; the caller holds s, the key's stripe
+ * @param link set to the index slot that refers to the entry, or to the
+ *        last link of the chain if key is absent
+ * @param walked incremented for each entry examined
+ * @return the entry's index, or CP_NIL
+ */
+static unsigned int cp_find(cp_table_t *t, cp_stripe_t *s, int key, unsigned int **link, int *walked)
+{
+  *link = &s->buckets[((unsigned int)key) % s->capacity];
+  while (**link != CP_NIL)
+  {
+    cp_entry_t *e = cp_at(t, **link);
+    (*walked)++;
+    if (e->key == key)
+      return **link;
+    *link = &e->next;
+  }
+  return CP_NIL;
+}
+
+/**
+ * Doubles the bucket array unless another thread has since oldCapacity
+ * was read, relinking the entries of each stripe into their new buckets
+ * under that stripe's lock. Entries do not move. A thread that finds a
+ * grow under way leaves it be.
+ */
+static void cp_grow(ts_hashmap_t *map, cp_table_t *t, unsigned int oldCapacity)
+{
+  if (pthread_mutex_trylock(&t->growLock) != 0)
+    return;
+
+  unsigned int capacity = oldCapacity * 2;
+  unsigned int *old = t->buckets;
+  unsigned int *buckets;
+  if (t->capacity != oldCapacity || oldCapacity >= CP_MAX_CAPACITY ||
+      (buckets = calloc(capacity, sizeof(unsigned int))) == NULL)
+  {
+    pthread_mutex_unlock(&t->growLock);
+    return;
+  }
+
+  for (int s = 0; s < t->numStripes; s++)
+  {
+    cp_stripe_t *stripe = &t->stripes[s];
+    ts_lock(&stripe->lock, t->lockKind);
+    for (unsigned int b = s; b < oldCapacity; b += t->numStripes)
+    {
+      unsigned int i = old[b];
+      while (i != CP_NIL)
+      {
+        cp_entry_t *e = cp_at(t, i);
+        unsigned int next = e->next;
+        unsigned int *head = &buckets[((unsigned int)e->key) % capacity];
+        e->next = *head;
+        *head = i;
+        i = next;
+      }
+    }
+    stripe->buckets = buckets;
+    stripe->capacity = capacity;
+    ts_unlock(&stripe->lock, t->lockKind);
+  }
+
+  // Every stripe has left the old array, and it is only read under them
+  t->buckets = buckets;
+  t->capacity = capacity;
+  __atomic_store_n(&map->capacity, (int)capacity, __ATOMIC_RELAXED);
+  free(old);
+  pthread_mutex_unlock(&t->growLock);
+}
+
+static int cp_get(ts_hashmap_t *map, int key)
+{
+  cp_table_t *t = map->impl;
+  cp_stripe_t *s = cp_stripe(t, key);
+  unsigned int *link;
+  int walked = 0;
+  int value = INT_MAX;
+
+  ts_lock(&s->lock, t->lockKind);
+  unsigned int i = cp_find(t, s, key, &link, &walked);
+  if (i != CP_NIL)
+    value = cp_at(t, i)->value;
+  ts_unlock(&s->lock, t->lockKind);
+
+  ts_counters_t *c = ts_counters(map);
+  __atomic_fetch_add(value != INT_MAX ? &c->hits : &c->misses, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&c->chainSteps, walked, __ATOMIC_RELAXED);
+  return value; // INT_MAX if not found
+}
+
+static int cp_put(ts_hashmap_t *map, int key, int value)
+{
+  cp_table_t *t = map->impl;
+  cp_stripe_t *s = cp_stripe(t, key);
+  unsigned int *link;
+  int walked = 0;
+  int returnVal = INT_MAX;
+
+  ts_lock(&s->lock, t->lockKind);
+  unsigned int i = cp_find(t, s, key, &link, &walked);
+  if (i != CP_NIL) // Key exists, replace the value
+  {
+    cp_entry_t *e = cp_at(t, i);
+    returnVal = e->value;
+    e->value = value;
+    ts_unlock(&s->lock, t->lockKind);
+    TS_COUNT(map, updates);
+    return returnVal;
+  }
+
+  i = cp_alloc(t, s);
+  if (i == CP_NIL)
+  {
+    ts_unlock(&s->lock, t->lockKind);
+    return TS_PUT_FAILED;
+  }
+  cp_entry_t *e = cp_at(t, i);
+  e->key = key;
+  e->value = value;
+  e->next = CP_NIL;
+  *link = i;
+  unsigned int capacity = s->capacity;
+  ts_unlock(&s->lock, t->lockKind);
+
+  TS_COUNT(map, inserts);
+  if (t->maxLoad > 0 && (++writesSinceCheck % TS_LOAD_CHECK) == 0 &&
+      ts_count_size(map) > capacity * t->maxLoad)
+    cp_grow(map, t, capacity);
+  return INT_MAX;
+}
+
+static int cp_del(ts_hashmap_t *map, int key)
+{
+  cp_table_t *t = map->impl;
+  cp_stripe_t *s = cp_stripe(t, key);
+  unsigned int *link;
+  int walked = 0;
+  int returnVal = INT_MAX;
+
+  ts_lock(&s->lock, t->lockKind);
+  unsigned int i = cp_find(t, s, key, &link, &walked);
+  if (i != CP_NIL)
+  {
+    cp_entry_t *e = cp_at(t, i);
+    returnVal = e->value;
+    *link = e->next;
+    e->next = s->freeList;
+    s->freeList = i;
+  }
+  ts_unlock(&s->lock, t->lockKind);
+
+  if (i != CP_NIL)
+    TS_COUNT(map, deletes);
+  else
+    TS_COUNT(map, delMisses);
+  return returnVal; // INT_MAX if not found
+}
+
+static void cp_print(ts_hashmap_t *map)
+{
+  cp_table_t *t = map->impl;
+  for (unsigned int b = 0; b < t->capacity; b++)
+  {
+    printf("[%u] -> ", b);
+    for (unsigned int i = t->buckets[b]; i != CP_NIL; i = cp_at(t, i)->next)
+      printf("(%d,%d) ", cp_at(t, i)->key, cp_at(t, i)->value);
+    printf("\n");
+  }
+}
+
+static void cp_free(ts_hashmap_t *map)
+{
+  cp_table_t *t = map->impl;
+  for (unsigned int c = 0; c < CP_CHUNKS; c++)
+    free(t->chunks[c]);
+  free(t->chunks);
+  for (int i = 0; i < t->numStripes; i++)
+    ts_lock_destroy(&t->stripes[i].lock, t->lockKind);
+  pthread_mutex_destroy(&t->growLock);
+  free(t->stripes);
+  free(t->buckets);
+  free(t);
+}
+
+/**
+ * Probe length is the key's position in its chain. Takes one stripe at a
+ * time, so each bucket is consistent but the whole is not a snapshot.
+ */
+static void cp_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  cp_table_t *t = map->impl;
+  long totalProbe = 0;
+  long entries = 0;
+
+  for (int s = 0; s < t->numStripes; s++)
+  {
+    cp_stripe_t *stripe = &t->stripes[s];
+    ts_lock(&stripe->lock, t->lockKind);
+    for (unsigned int b = s; b < stripe->capacity; b += t->numStripes)
+    {
+      int probe = 0;
+      for (unsigned int i = stripe->buckets[b]; i != CP_NIL; i = cp_at(t, i)->next)
+      {
+        probe++;
+        totalProbe += probe;
+        entries++;
+      }
+      if (probe > stats->maxProbe)
+        stats->maxProbe = probe;
+    }
+    ts_unlock(&stripe->lock, t->lockKind);
+  }
+
+  if (entries > 0)
+    stats->meanProbe = (double)totalProbe / entries;
+}
+
+const ts_ops_t ts_compact_ops = {
+  .init = cp_init,
+  .get = cp_get,
+  .put = cp_put,
+  .del = cp_del,
+  .print = cp_print,
+  .free = cp_free,
+  .stats = cp_stats,
+};
@@ -0,0 +1,536 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ts_backend.h"
+
+#define CU_SLOTS 4            // ways per bucket
+#define CU_FULL ((1u << CU_SLOTS) - 1)
+#define CU_LOCKS 1024         // lock stripes, a power of two
+#define CU_MAX_DEPTH 5        // longest cuckoo path a BFS looks for
+#define CU_MAX_NODES 1024     // BFS queue size; bounds the search width
+#define CU_MAX_KICKS 512      // displacements per key while rehashing
+
+// A bucket holds four keys and values and fills one cache line, so a
+// lookup reads exactly the two lines of the key's two candidate buckets.
+typedef struct cu_bucket_t {
+  int keys[CU_SLOTS];
+  int values[CU_SLOTS];
+  unsigned int occupied;      // bit i set when slot i holds an entry
+} __attribute__((aligned(64))) cu_bucket_t;
+
+// Each stripe fills its own cache line, so threads taking neighboring
+// stripes do not bounce one line between them.
+typedef struct cu_lock_t {
+  pthread_mutex_t lock;
+} __attribute__((aligned(64))) cu_lock_t;
+
+// Bucket b is guarded by locks[b % CU_LOCKS]; an operation on a key holds
+// the stripes of both its buckets. Growing takes every stripe, so a thread
+// that computed its buckets before acquiring its stripes rechecks mask
+// afterwards and starts over if the table was resized meanwhile.
+typedef struct cu_table_t {
+  cu_bucket_t *buckets;
+  unsigned int mask;          // number of buckets - 1, changes only when growing
+  cu_lock_t locks[CU_LOCKS];
+} cu_table_t;
+
+// One step of a cuckoo path: the key in slot of bucket moves to its other
+// bucket, the bucket of the next step
+typedef struct cu_step_t {
+  unsigned int bucket;
+  int slot;
+  int key;
+  int parent;                 // index of the previous step in the BFS queue
+  int depth;
+} cu_step_t;
+
+static inline unsigned int cu_mix(unsigned int h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+/**
+ * The two candidate buckets of a key; they always differ
+ */
+static inline void cu_index(int key, unsigned int mask, unsigned int *b1, unsigned int *b2)
+{
+  *b1 = cu_mix((unsigned int)key) & mask;
+  *b2 = cu_mix((unsigned int)key ^ 0x9e3779b9u) & mask;
+  if (*b2 == *b1)
+    *b2 = *b1 ^ 1;
+}
+
+static inline unsigned int cu_other(int key, unsigned int mask, unsigned int b)
+{
+  unsigned int b1, b2;
+  cu_index(key, mask, &b1, &b2);
+  return b == b1 ? b2 : b1;
+}
+
+static inline unsigned int cu_load_mask(cu_table_t *t)
+{
+  return __atomic_load_n(&t->mask, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Locks the stripes of two buckets in stripe order
+ */
+static void cu_lock_two(cu_table_t *t, unsigned int b1, unsigned int b2)
+{
+  unsigned int l1 = b1 % CU_LOCKS;
+  unsigned int l2 = b2 % CU_LOCKS;
+  if (l1 > l2)
+  {
+    unsigned int temp = l1;
+    l1 = l2;
+    l2 = temp;
+  }
+  pthread_mutex_lock(&t->locks[l1].lock);
+  if (l2 != l1)
+    pthread_mutex_lock(&t->locks[l2].lock);
+}
+
+static void cu_unlock_two(cu_table_t *t, unsigned int b1, unsigned int b2)
+{
+  unsigned int l1 = b1 % CU_LOCKS;
+  unsigned int l2 = b2 % CU_LOCKS;
+  pthread_mutex_unlock(&t->locks[l1].lock);
+  if (l2 != l1)
+    pthread_mutex_unlock(&t->locks[l2].lock);
+}
+
+/**
+ * Locks both buckets of key against the current table size
+ * @return the mask the buckets were computed with
+ */
+static unsigned int cu_lock_key(cu_table_t *t, int key, unsigned int *b1, unsigned int *b2)
+{
+  while (1)
+  {
+    unsigned int mask = cu_load_mask(t);
+    cu_index(key, mask, b1, b2);
+    cu_lock_two(t, *b1, *b2);
+    if (mask == t->mask)
+      return mask;
+    cu_unlock_two(t, *b1, *b2); // Resized while we waited
+  }
+}
+
+/**
+ * Slot of key in bucket b, or -1
+ */
+static int cu_slot_of(const cu_bucket_t *b, int key)
+{
+  for (int s = 0; s < CU_SLOTS; s++)
+  {
+    if ((b->occupied & (1u << s)) && b->keys[s] == key)
+      return s;
+  }
+  return -1;
+}
+
+static inline int cu_free_slot(const cu_bucket_t *b)
+{
+  return b->occupied == CU_FULL ? -1 : __builtin_ctz(~b->occupied);
+}
+
+/**
+ * Inserts into a table only the caller can see, kicking keys to their
+ * other bucket when both candidates are full.
+ * @return 0, or -1 if the key could not be placed (the table is then
+ *         inconsistent and should be discarded)
+ */
+static int cu_place_private(cu_bucket_t *buckets, unsigned int mask, int key, int value)
+{
+  unsigned int victim = (unsigned int)key;
+
+  for (int kick = 0; kick < CU_MAX_KICKS; kick++)
+  {
+    unsigned int b1, b2;
+    cu_index(key, mask, &b1, &b2);
+    unsigned int b = b1;
+    int s = cu_free_slot(&buckets[b1]);
+    if (s < 0)
+    {
+      b = b2;
+      s = cu_free_slot(&buckets[b2]);
+    }
+    if (s >= 0)
+    {
+      buckets[b].keys[s] = key;
+      buckets[b].values[s] = value;
+      buckets[b].occupied |= 1u << s;
+      return 0;
+    }
+
+    // Evict a pseudo-random victim and place it next
+    victim = victim * 1103515245u + 12345u;
+    b = (victim >> 16) & 1 ? b2 : b1;
+    s = (victim >> 17) % CU_SLOTS;
+    int tempKey = buckets[b].keys[s];
+    int tempValue = buckets[b].values[s];
+    buckets[b].keys[s] = key;
+    buckets[b].values[s] = value;
+    key = tempKey;
+    value = tempValue;
+  }
+  return -1;
+}
+
+static cu_bucket_t *cu_alloc_buckets(unsigned int n)
+{
+  cu_bucket_t *buckets = aligned_alloc(64, sizeof(cu_bucket_t) * n);
+  if (buckets != NULL)
+    memset(buckets, 0, sizeof(cu_bucket_t) * n);
+  return buckets;
+}
+
+/**
+ * Doubles the table unless another thread already grew it past
+ * seenMask. Holds every stripe while it rehashes.
+ * @return 0 if the table is now bigger than seenMask, or -1 if it could
+ *         not be grown, for want of memory or past 2^30 buckets
+ */
+static int cu_grow(ts_hashmap_t *map, unsigned int seenMask)
+{
+  cu_table_t *t = map->impl;
+  int result = 0;
+
+  for (int i = 0; i < CU_LOCKS; i++)
+    pthread_mutex_lock(&t->locks[i].lock);
+
+  if (t->mask == seenMask)
+  {
+    unsigned int n = (t->mask + 1) * 2;
+    cu_bucket_t *buckets = NULL;
+    while (buckets == NULL && n < (1u << 30))
+    {
+      if ((buckets = cu_alloc_buckets(n)) == NULL)
+        break;
+      int placed = 1;
+      for (unsigned int b = 0; placed && b <= t->mask; b++)
+      {
+        for (int s = 0; placed && s < CU_SLOTS; s++)
+        {
+          if (t->buckets[b].occupied & (1u << s))
+            placed = (cu_place_private(buckets, n - 1, t->buckets[b].keys[s], t->buckets[b].values[s]) == 0);
+        }
+      }
+      if (!placed)
+      {
+        free(buckets);
+        buckets = NULL;
+        n *= 2;
+      }
+    }
+
+    if (buckets != NULL)
+    {
+      free(t->buckets);
+      t->buckets = buckets;
+      __atomic_store_n(&t->mask, n - 1, __ATOMIC_RELEASE);
+      map->capacity = n * CU_SLOTS;
+    }
+    else
+    {
+      result = -1;
+    }
+  }
+
+  for (int i = CU_LOCKS - 1; i >= 0; i--)
+    pthread_mutex_unlock(&t->locks[i].lock);
+  return result;
+}
+
+/**
+ * Breadth-first search outward from b1 and b2 for a bucket with a free
+ * slot, following each key to its other bucket. Buckets are locked one at
+ * a time, only long enough to copy them.
+ * @param queue scratch space for CU_MAX_NODES steps
+ * @return index in queue of the step that reached a free slot, or -1
+ */
+static int cu_search(cu_table_t *t, unsigned int mask, unsigned int b1, unsigned int b2, cu_step_t *queue)
+{
+  int head = 0;
+  int tail = 0;
+  queue[tail++] = (cu_step_t){ .bucket = b1, .slot = -1, .parent = -1, .depth = 0 };
+  queue[tail++] = (cu_step_t){ .bucket = b2, .slot = -1, .parent = -1, .depth = 0 };
+
+  while (head < tail)
+  {
+    int n = head++;
+    unsigned int b = queue[n].bucket;
+    pthread_mutex_t *lock = &t->locks[b % CU_LOCKS].lock;
+
+    pthread_mutex_lock(lock);
+    if (t->mask != mask)
+    {
+      pthread_mutex_unlock(lock);
+      return -1;
+    }
+    cu_bucket_t copy = t->buckets[b];
+    pthread_mutex_unlock(lock);
+
+    if (copy.occupied != CU_FULL)
+      return n;
+    if (queue[n].depth + 1 >= CU_MAX_DEPTH)
+      continue;
+
+    for (int s = 0; s < CU_SLOTS && tail < CU_MAX_NODES; s++)
+    {
+      queue[tail++] = (cu_step_t){
+        .bucket = cu_other(copy.keys[s], mask, b),
+        .slot = s,
+        .key = copy.keys[s],
+        .parent = n,
+        .depth = queue[n].depth + 1,
+      };
+    }
+  }
+  return -1;
+}
+
+/**
+ * Moves keys along the path found by cu_search, last step first, so that
+ * a slot of the starting bucket frees up. Each move locks only its source
+ * and destination bucket and checks that the key is still where the
+ * search saw it.
+ * @return 0 on success, -1 if the table changed under the path
+ */
+static int cu_apply_path(cu_table_t *t, unsigned int mask, cu_step_t *queue, int end)
+{
+  for (int n = end; queue[n].parent >= 0; n = queue[n].parent)
+  {
+    unsigned int from = queue[queue[n].parent].bucket;
+    unsigned int to = queue[n].bucket;
+    int moved = -1;
+
+    cu_lock_two(t, from, to);
+    if (t->mask == mask)
+    {
+      cu_bucket_t *src = &t->buckets[from];
+      cu_bucket_t *dst = &t->buckets[to];
+      int s = queue[n].slot;
+      int d = cu_free_slot(dst);
+      if (d >= 0 && (src->occupied & (1u << s)) && src->keys[s] == queue[n].key)
+      {
+        dst->keys[d] = src->keys[s];
+        dst->values[d] = src->values[s];
+        dst->occupied |= 1u << d;
+        src->occupied &= ~(1u << s);
+        moved = 0;
+      }
+    }
+    cu_unlock_two(t, from, to);
+
+    if (moved != 0)
+      return -1;
+  }
+  return 0;
+}
+
+static int cu_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  cu_table_t *t = aligned_alloc(64, sizeof(cu_table_t));
+  unsigned int n = 2;
+  while (n < (1u << 28) && n * CU_SLOTS < (unsigned int)config->capacity)
+    n *= 2;
+
+  if (t == NULL || (t->buckets = cu_alloc_buckets(n)) == NULL)
+  {
+    free(t);
+    return -1;
+  }
+  t->mask = n - 1;
+  for (int i = 0; i < CU_LOCKS; i++)
+    pthread_mutex_init(&t->locks[i].lock, NULL);
+
+  map->impl = t;
+  map->capacity = n * CU_SLOTS;
+  return 0;
+}
+
+static int cu_get(ts_hashmap_t *map, int key)
+{
+  cu_table_t *t = map->impl;
+  unsigned int b1, b2;
+  int returnVal = INT_MAX;
+
+  cu_lock_key(t, key, &b1, &b2);
+  int s = cu_slot_of(&t->buckets[b1], key);
+  if (s >= 0)
+  {
+    returnVal = t->buckets[b1].values[s];
+  }
+  else if ((s = cu_slot_of(&t->buckets[b2], key)) >= 0)
+  {
+    returnVal = t->buckets[b2].values[s];
+  }
+  cu_unlock_two(t, b1, b2);
+  ts_count_get(map, returnVal);
+  return returnVal;
+}
+
+static int cu_put(ts_hashmap_t *map, int key, int value)
+{
+  cu_table_t *t = map->impl;
+  cu_step_t queue[CU_MAX_NODES];
+  unsigned int b1, b2;
+
+  while (1)
+  {
+    unsigned int mask = cu_lock_key(t, key, &b1, &b2);
+    cu_bucket_t *bucket1 = &t->buckets[b1];
+    cu_bucket_t *bucket2 = &t->buckets[b2];
+    cu_bucket_t *target;
+    int s;
+
+    target = bucket1;
+    if ((s = cu_slot_of(bucket1, key)) < 0)
+    {
+      target = bucket2;
+      s = cu_slot_of(bucket2, key);
+    }
+    if (s >= 0) // Key exists, replace the value
+    {
+      int temp = target->values[s];
+      target->values[s] = value;
+      cu_unlock_two(t, b1, b2);
+      TS_COUNT(map, updates);
+      return temp;
+    }
+
+    target = bucket1;
+    if ((s = cu_free_slot(bucket1)) < 0)
+    {
+      target = bucket2;
+      s = cu_free_slot(bucket2);
+    }
+    if (s >= 0)
+    {
+      target->keys[s] = key;
+      target->values[s] = value;
+      target->occupied |= 1u << s;
+      cu_unlock_two(t, b1, b2);
+      TS_COUNT(map, inserts);
+      return INT_MAX;
+    }
+    cu_unlock_two(t, b1, b2);
+
+    // Both buckets are full: make room along a cuckoo path, or grow if
+    // there is none within CU_MAX_DEPTH moves. Either way, try again,
+    // unless the table could not grow.
+    int end = cu_search(t, mask, b1, b2, queue);
+    if (end < 0)
+    {
+      if (cu_load_mask(t) == mask && cu_grow(map, mask) < 0)
+        return TS_PUT_FAILED;
+    }
+    else
+    {
+      cu_apply_path(t, mask, queue, end);
+    }
+  }
+}
+
+static int cu_del(ts_hashmap_t *map, int key)
+{
+  cu_table_t *t = map->impl;
+  unsigned int b1, b2;
+  int returnVal = INT_MAX;
+
+  cu_lock_key(t, key, &b1, &b2);
+  cu_bucket_t *bucket = &t->buckets[b1];
+  int s = cu_slot_of(bucket, key);
+  if (s < 0)
+  {
+    bucket = &t->buckets[b2];
+    s = cu_slot_of(bucket, key);
+  }
+  if (s >= 0)
+  {
+    returnVal = bucket->values[s];
+    bucket->occupied &= ~(1u << s);
+  }
+  cu_unlock_two(t, b1, b2);
+  if (s >= 0)
+    TS_COUNT(map, deletes);
+  else
+    TS_COUNT(map, delMisses);
+  return returnVal;
+}
+
+static void cu_print(ts_hashmap_t *map)
+{
+  cu_table_t *t = map->impl;
+  for (unsigned int b = 0; b <= t->mask; b++)
+  {
+    printf("[%u] -> ", b);
+    for (int s = 0; s < CU_SLOTS; s++)
+    {
+      if (t->buckets[b].occupied & (1u << s))
+        printf("(%d,%d) ", t->buckets[b].keys[s], t->buckets[b].values[s]);
+    }
+    printf("\n");
+  }
+}
+
+static void cu_free(ts_hashmap_t *map)
+{
+  cu_table_t *t = map->impl;
+  for (int i = 0; i < CU_LOCKS; i++)
+    pthread_mutex_destroy(&t->locks[i].lock);
+  free(t->buckets);
+  free(t);
+}
+
+/**
+ * Probe lengths count buckets: 1 for a key in its first bucket,
+ * 2 for one in its second.
+ */
+static void cu_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  cu_table_t *t = map->impl;
+  long totalProbe = 0;
+  int entries = 0;
+
+  for (int i = 0; i < CU_LOCKS; i++)
+    pthread_mutex_lock(&t->locks[i].lock);
+  for (unsigned int b = 0; b <= t->mask; b++)
+  {
+    for (int s = 0; s < CU_SLOTS; s++)
+    {
+      if (!(t->buckets[b].occupied & (1u << s)))
+        continue;
+      unsigned int b1, b2;
+      cu_index(t->buckets[b].keys[s], t->mask, &b1, &b2);
+      int probe = (b == b1) ? 1 : 2;
+      totalProbe += probe;
+      entries++;
+      if (probe > stats->maxProbe)
+        stats->maxProbe = probe;
+    }
+  }
+  for (int i = CU_LOCKS - 1; i >= 0; i--)
+    pthread_mutex_unlock(&t->locks[i].lock);
+
+  if (entries > 0)
+    stats->meanProbe = (double)totalProbe / entries;
+}
+
+const ts_ops_t ts_cuckoo_ops = {
+  .init = cu_init,
+  .get = cu_get,
+  .put = cu_put,
+  .del = cu_del,
+  .print = cu_print,
+  .free = cu_free,
+  .stats = cu_stats,
+};
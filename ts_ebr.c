@@ -0,0 +1,193 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ts_ebr.h"
+
+#define EBR_ACTIVE 1ul       // low bit of an announcement: inside a section
+
+typedef struct ebr_item_t {
+  void *p;
+  void (*destroy)(void *);
+} ebr_item_t;
+
+// Nodes one thread retired during one epoch
+typedef struct ebr_bag_t {
+  ebr_item_t *items;
+  int count;
+  int size;
+  unsigned long epoch;
+} ebr_bag_t;
+
+// One per thread, on a list that only grows. announce is read by every
+// thread that tries to advance the epoch, so each record has its own
+// cache line.
+typedef struct ebr_thread_t {
+  unsigned long announce;    // epoch << 1, plus EBR_ACTIVE while inside
+  int nesting;
+  int inUse;
+  int sinceReclaim;
+  ebr_bag_t bags[3];
+  struct ebr_thread_t *next;
+} __attribute__((aligned(64))) ebr_thread_t;
+
+static unsigned long globalEpoch = 0;
+static ebr_thread_t *threads = NULL;
+static pthread_key_t exitKey;
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static __thread ebr_thread_t *self = NULL;
+
+/**
+ * Runs when a registered thread exits. Its retired nodes stay in the
+ * record for whichever thread takes it over.
+ */
+static void ebr_thread_exit(void *arg)
+{
+  ebr_thread_t *r = arg;
+  __atomic_store_n(&r->announce, r->announce & ~EBR_ACTIVE, __ATOMIC_RELEASE);
+  __atomic_store_n(&r->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void ebr_make_key(void)
+{
+  pthread_key_create(&exitKey, ebr_thread_exit);
+}
+
+/**
+ * Returns the calling thread's record, claiming an abandoned one or
+ * adding a new one the first time
+ */
+static ebr_thread_t *ebr_self(void)
+{
+  if (self != NULL)
+    return self;
+
+  pthread_once(&keyOnce, ebr_make_key);
+  for (ebr_thread_t *r = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); r != NULL && self == NULL; r = r->next)
+  {
+    int unused = 0;
+    if (__atomic_load_n(&r->inUse, __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&r->inUse, &unused, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      self = r;
+  }
+
+  if (self == NULL)
+  {
+    ebr_thread_t *r = aligned_alloc(64, sizeof(ebr_thread_t));
+    memset(r, 0, sizeof(ebr_thread_t));
+    r->inUse = 1;
+    r->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    self = r;
+  }
+  pthread_setspecific(exitKey, self);
+  return self;
+}
+
+/**
+ * Starts a critical section: nodes reachable now will not be freed
+ * until the matching ts_ebr_exit()
+ */
+void ts_ebr_enter(void)
+{
+  ebr_thread_t *r = ebr_self();
+  if (r->nesting++ == 0)
+  {
+    // The announcement must be visible before any shared node is read,
+    // and must name the epoch that is still current at that point
+    unsigned long epoch;
+    do
+    {
+      epoch = __atomic_load_n(&globalEpoch, __ATOMIC_RELAXED);
+      __atomic_store_n(&r->announce, (epoch << 1) | EBR_ACTIVE, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } while (__atomic_load_n(&globalEpoch, __ATOMIC_RELAXED) != epoch);
+  }
+}
+
+void ts_ebr_exit(void)
+{
+  ebr_thread_t *r = self;
+  if (--r->nesting == 0)
+    __atomic_store_n(&r->announce, r->announce & ~EBR_ACTIVE, __ATOMIC_RELEASE);
+}
+
+static void ebr_free_bag(ebr_bag_t *bag)
+{
+  for (int i = 0; i < bag->count; i++)
+    bag->items[i].destroy(bag->items[i].p);
+  __atomic_store_n(&bag->count, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Moves the global epoch on if every thread inside a section has
+ * announced the current one
+ * @return the global epoch afterwards
+ */
+static unsigned long ebr_try_advance(void)
+{
+  unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pairs with the one in ts_ebr_enter()
+  for (ebr_thread_t *r = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); r != NULL; r = r->next)
+  {
+    unsigned long announce = __atomic_load_n(&r->announce, __ATOMIC_ACQUIRE);
+    if ((announce & EBR_ACTIVE) && (announce >> 1) != epoch)
+      return epoch; // Still inside an older epoch
+  }
+  __atomic_compare_exchange_n(&globalEpoch, &epoch, epoch + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Frees p with destroy (free() if NULL) once no thread can still be
+ * reading it. Call after p has been unlinked from every shared structure.
+ */
+void ts_ebr_retire(void *p, void (*destroy)(void *))
+{
+  ebr_thread_t *r = ebr_self();
+
+  // The unlink must be visible before the epoch it is filed under is read
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+  ebr_bag_t *bag = &r->bags[epoch % 3];
+
+  if (bag->epoch != epoch) // Still holds nodes from three or more epochs ago
+  {
+    ebr_free_bag(bag);
+    bag->epoch = epoch;
+  }
+  if (bag->count == bag->size)
+  {
+    bag->size = bag->size ? bag->size * 2 : TS_EBR_BATCH;
+    bag->items = realloc(bag->items, sizeof(ebr_item_t) * bag->size);
+  }
+  bag->items[bag->count].p = p;
+  bag->items[bag->count].destroy = destroy ? destroy : free;
+  __atomic_store_n(&bag->count, bag->count + 1, __ATOMIC_RELAXED);
+
+  if (++r->sinceReclaim >= TS_EBR_BATCH)
+  {
+    r->sinceReclaim = 0;
+    epoch = ebr_try_advance();
+    for (int i = 0; i < 3; i++)
+    {
+      if (r->bags[i].epoch + 2 <= epoch)
+        ebr_free_bag(&r->bags[i]);
+    }
+  }
+}
+
+/**
+ * Counts the nodes retired by every thread and not yet freed. Other
+ * threads keep retiring meanwhile, so the count is approximate.
+ */
+long ts_ebr_pending(void)
+{
+  long pending = 0;
+  for (ebr_thread_t *r = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); r != NULL; r = r->next)
+  {
+    for (int i = 0; i < 3; i++)
+      pending += __atomic_load_n(&r->bags[i].count, __ATOMIC_RELAXED);
+  }
+  return pending;
+}
@@ -0,0 +1,29 @@
+#ifndef TS_EBR_H_
+#define TS_EBR_H_
+
+// Epoch-based reclamation. A thread that reads shared nodes without a
+// lock does so between ts_ebr_enter() and ts_ebr_exit(). Unlinked nodes
+// are handed to ts_ebr_retire() instead of free(), and are freed once
+// every thread that might still hold them has left its critical section.
+//
+// There is one global epoch. Each thread announces the epoch it entered
+// in and keeps its own retired nodes in three bags, one per epoch modulo
+// 3. Every TS_EBR_BATCH retirements the thread tries to advance the
+// epoch; a bag is freed when the epoch is two past the one it was filled
+// in, as no reader can still be inside that epoch by then.
+//
+// A thread that stalls inside a section holds the epoch back, so there
+// is no bound on how much can be waiting to be freed meanwhile; see
+// ts_hazard.h for a scheme with one.
+//
+// Sections nest. Threads register on first use; a thread that exits
+// leaves its record, with anything still retired, to the next new thread.
+
+#define TS_EBR_BATCH 64      // retirements between attempts to reclaim
+
+void ts_ebr_enter(void);
+void ts_ebr_exit(void);
+void ts_ebr_retire(void*, void (*)(void*));
+long ts_ebr_pending(void);
+
+#endif /* TS_EBR_H_ */
@@ -0,0 +1,412 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ts_backend.h"
+
+#define EH_PAGE_SLOTS 16     // keys per bucket page
+#define EH_MAX_DEPTH 30      // the directory stops doubling here
+#define EH_MERGE_SLOTS (EH_PAGE_SLOTS / 2) // keys a page and its buddy merge at
+
+// A page holds the keys whose hash ends in its localDepth low bits. The
+// directory has 2^globalDepth entries and every entry whose index ends
+// in those bits points to the page, so splitting a page only rewrites
+// its own entries.
+typedef struct eh_page_t {
+  pthread_mutex_t lock;
+  int localDepth;
+  int count;
+  int keys[EH_PAGE_SLOTS];
+  int values[EH_PAGE_SLOTS];
+} eh_page_t;
+
+// Operations hold dirLock shared, then lock a page. A split rewrites the
+// page's directory entries while holding the page lock, so an operation
+// rechecks its entry once it has the page. Doubling the directory, and
+// merging pages and halving it as keys are deleted, take dirLock
+// exclusively.
+typedef struct eh_table_t {
+  pthread_rwlock_t dirLock;
+  eh_page_t **dir;
+  int globalDepth;
+  int pages;
+} eh_table_t;
+
+static inline unsigned int eh_hash(int key)
+{
+  unsigned int h = (unsigned int)key;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static eh_page_t *eh_alloc_page(int localDepth)
+{
+  eh_page_t *p = malloc(sizeof(eh_page_t));
+  if (p == NULL)
+    return NULL;
+  pthread_mutex_init(&p->lock, NULL);
+  p->localDepth = localDepth;
+  p->count = 0;
+  return p;
+}
+
+/**
+ * Locks the page that holds h. Caller holds dirLock shared.
+ */
+static eh_page_t *eh_lock_page(eh_table_t *t, unsigned int h)
+{
+  unsigned int i = h & ((1u << t->globalDepth) - 1);
+  while (1)
+  {
+    eh_page_t *p = __atomic_load_n(&t->dir[i], __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&p->lock);
+    if (__atomic_load_n(&t->dir[i], __ATOMIC_RELAXED) == p)
+      return p;
+    pthread_mutex_unlock(&p->lock); // Split while we waited
+  }
+}
+
+static int eh_find(const eh_page_t *p, int key)
+{
+  for (int s = 0; s < p->count; s++)
+  {
+    if (p->keys[s] == key)
+      return s;
+  }
+  return -1;
+}
+
+/**
+ * Splits full page p on hash bit p->localDepth, moving the keys with that
+ * bit set to a new page and pointing their directory entries at it.
+ * Caller holds dirLock shared and p's lock, and p->localDepth is below
+ * the global depth.
+ * @return 0, or -1 if the new page could not be allocated
+ */
+static int eh_split(eh_table_t *t, eh_page_t *p)
+{
+  eh_page_t *sibling = eh_alloc_page(p->localDepth + 1);
+  if (sibling == NULL)
+    return -1;
+
+  unsigned int bit = 1u << p->localDepth;
+  unsigned int low = (eh_hash(p->keys[0]) & (bit - 1)) | bit;  // first entry to move
+  int kept = 0;
+  for (int s = 0; s < p->count; s++)
+  {
+    if (eh_hash(p->keys[s]) & bit)
+    {
+      sibling->keys[sibling->count] = p->keys[s];
+      sibling->values[sibling->count++] = p->values[s];
+    }
+    else
+    {
+      p->keys[kept] = p->keys[s];
+      p->values[kept++] = p->values[s];
+    }
+  }
+  p->count = kept;
+  p->localDepth++;
+
+  // Entries ending in the page's old bits plus the new bit move over
+  for (unsigned int i = low; i < (1u << t->globalDepth); i += bit << 1)
+    __atomic_store_n(&t->dir[i], sibling, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&t->pages, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/**
+ * Doubles the directory, unless another thread already did since the
+ * caller saw depth. The new upper half repeats the lower one, so every
+ * page keeps its keys.
+ * @return 0, or -1 if the directory could not grow
+ */
+static int eh_double(eh_table_t *t, int depth)
+{
+  int ret = 0;
+  pthread_rwlock_wrlock(&t->dirLock);
+  if (t->globalDepth == depth)
+  {
+    unsigned int n = 1u << depth;
+    eh_page_t **dir = (depth < EH_MAX_DEPTH) ? realloc(t->dir, sizeof(eh_page_t *) * n * 2) : NULL;
+    if (dir != NULL)
+    {
+      for (unsigned int i = 0; i < n; i++)
+        dir[n + i] = dir[i];
+      t->dir = dir;
+      t->globalDepth++;
+    }
+    else
+    {
+      ret = -1;
+    }
+  }
+  pthread_rwlock_unlock(&t->dirLock);
+  return ret;
+}
+
+/**
+ * Whether p, the page holding h, which the caller has locked, and its
+ * buddy, the page it split from or that split from it, now fit in one
+ * page with half of it to spare. The buddy's lock is only tried, as the
+ * caller already holds a page lock. Caller holds dirLock shared.
+ */
+static int eh_mergeable(eh_table_t *t, eh_page_t *p, unsigned int h)
+{
+  if (p->localDepth == 0 || p->count > EH_MERGE_SLOTS)
+    return 0;
+  unsigned int i = h & ((1u << t->globalDepth) - 1);
+  eh_page_t *buddy = __atomic_load_n(&t->dir[i ^ (1u << (p->localDepth - 1))], __ATOMIC_ACQUIRE);
+  if (pthread_mutex_trylock(&buddy->lock) != 0)
+    return 0;
+  int fits = buddy->localDepth == p->localDepth && p->count + buddy->count <= EH_MERGE_SLOTS;
+  pthread_mutex_unlock(&buddy->lock);
+  return fits;
+}
+
+/**
+ * Merges the page holding h into its buddy for as long as the two fit
+ * in EH_MERGE_SLOTS, then halves the directory while no page uses its
+ * top bit. Holds dirLock exclusively, so no operation is on any page and
+ * the emptied ones are freed at once.
+ */
+static void eh_merge(ts_hashmap_t *map, eh_table_t *t, unsigned int h)
+{
+  pthread_rwlock_wrlock(&t->dirLock);
+  unsigned int i = h & ((1u << t->globalDepth) - 1);
+  eh_page_t *p = t->dir[i];
+  while (p->localDepth > 0)
+  {
+    unsigned int bit = 1u << (p->localDepth - 1);
+    eh_page_t *buddy = t->dir[i ^ bit];
+    if (buddy->localDepth != p->localDepth || p->count + buddy->count > EH_MERGE_SLOTS)
+      break;
+
+    // The page on the side of the clear bit stays, as a split would have left it
+    eh_page_t *kept = (i & bit) ? buddy : p;
+    eh_page_t *gone = (i & bit) ? p : buddy;
+    for (int s = 0; s < gone->count; s++)
+    {
+      kept->keys[kept->count] = gone->keys[s];
+      kept->values[kept->count++] = gone->values[s];
+    }
+    kept->localDepth--;
+    for (unsigned int j = i & (bit - 1); j < (1u << t->globalDepth); j += bit)
+      t->dir[j] = kept;
+    pthread_mutex_destroy(&gone->lock);
+    free(gone);
+    __atomic_fetch_sub(&t->pages, 1, __ATOMIC_RELAXED);
+    p = kept;
+  }
+
+  while (t->globalDepth > 0)
+  {
+    unsigned int n = 1u << t->globalDepth;
+    unsigned int j = 0;
+    while (j < n && t->dir[j]->localDepth < t->globalDepth)
+      j++;
+    if (j < n)
+      break;
+    t->globalDepth--;
+  }
+  eh_page_t **dir = realloc(t->dir, sizeof(eh_page_t *) << t->globalDepth);
+  if (dir != NULL) // Else the old, longer directory serves as well
+    t->dir = dir;
+  __atomic_store_n(&map->capacity, t->pages * EH_PAGE_SLOTS, __ATOMIC_RELAXED);
+  pthread_rwlock_unlock(&t->dirLock);
+}
+
+/**
+ * Starts from a single page and grows one page at a time, so the
+ * capacity hint is not used.
+ */
+static int eh_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  eh_table_t *t = malloc(sizeof(eh_table_t));
+  eh_page_t **dir = malloc(sizeof(eh_page_t *));
+  eh_page_t *p = eh_alloc_page(0);
+
+  if (t == NULL || dir == NULL || p == NULL)
+  {
+    free(t);
+    free(dir);
+    free(p);
+    return -1;
+  }
+  pthread_rwlock_init(&t->dirLock, NULL);
+  dir[0] = p;
+  t->dir = dir;
+  t->globalDepth = 0;
+  t->pages = 1;
+
+  map->impl = t;
+  map->capacity = EH_PAGE_SLOTS;
+  return 0;
+}
+
+static int eh_get(ts_hashmap_t *map, int key)
+{
+  eh_table_t *t = map->impl;
+  int returnVal = INT_MAX;
+
+  pthread_rwlock_rdlock(&t->dirLock);
+  eh_page_t *p = eh_lock_page(t, eh_hash(key));
+  int s = eh_find(p, key);
+  if (s >= 0)
+    returnVal = p->values[s];
+  pthread_mutex_unlock(&p->lock);
+  pthread_rwlock_unlock(&t->dirLock);
+  ts_count_get(map, returnVal);
+  return returnVal;
+}
+
+static int eh_put(ts_hashmap_t *map, int key, int value)
+{
+  eh_table_t *t = map->impl;
+  unsigned int h = eh_hash(key);
+
+  while (1)
+  {
+    pthread_rwlock_rdlock(&t->dirLock);
+    eh_page_t *p = eh_lock_page(t, h);
+
+    int s = eh_find(p, key);
+    if (s >= 0) // Key exists, replace the value
+    {
+      int temp = p->values[s];
+      p->values[s] = value;
+      pthread_mutex_unlock(&p->lock);
+      pthread_rwlock_unlock(&t->dirLock);
+      TS_COUNT(map, updates);
+      return temp;
+    }
+
+    if (p->count < EH_PAGE_SLOTS)
+    {
+      p->keys[p->count] = key;
+      p->values[p->count++] = value;
+      pthread_mutex_unlock(&p->lock);
+      pthread_rwlock_unlock(&t->dirLock);
+      TS_COUNT(map, inserts);
+      return INT_MAX;
+    }
+
+    // Page full: split it, doubling the directory first if the page
+    // already uses every directory bit. Then retry.
+    int depth = t->globalDepth;
+    int split = (p->localDepth < depth) ? eh_split(t, p) : 1;
+    pthread_mutex_unlock(&p->lock);
+    pthread_rwlock_unlock(&t->dirLock);
+
+    if (split < 0 || (split > 0 && eh_double(t, depth) < 0))
+      return TS_PUT_FAILED; // Out of memory, or the keys share every hash bit
+    if (split == 0)
+      __atomic_store_n(&map->capacity, __atomic_load_n(&t->pages, __ATOMIC_RELAXED) * EH_PAGE_SLOTS,
+                       __ATOMIC_RELAXED);
+  }
+}
+
+static int eh_del(ts_hashmap_t *map, int key)
+{
+  eh_table_t *t = map->impl;
+  unsigned int h = eh_hash(key);
+  int returnVal = INT_MAX;
+  int merge = 0;
+
+  pthread_rwlock_rdlock(&t->dirLock);
+  eh_page_t *p = eh_lock_page(t, h);
+  int s = eh_find(p, key);
+  if (s >= 0) // Fill the hole with the page's last key
+  {
+    returnVal = p->values[s];
+    p->count--;
+    p->keys[s] = p->keys[p->count];
+    p->values[s] = p->values[p->count];
+    merge = eh_mergeable(t, p, h);
+  }
+  pthread_mutex_unlock(&p->lock);
+  pthread_rwlock_unlock(&t->dirLock);
+
+  if (merge)
+    eh_merge(map, t, h);
+  if (s >= 0)
+    TS_COUNT(map, deletes);
+  else
+    TS_COUNT(map, delMisses);
+  return returnVal;
+}
+
+static void eh_print(ts_hashmap_t *map)
+{
+  eh_table_t *t = map->impl;
+  for (unsigned int i = 0; i < (1u << t->globalDepth); i++)
+  {
+    eh_page_t *p = t->dir[i];
+    if (i >= (1u << p->localDepth)) // Printed at its first entry already
+      continue;
+    printf("[%u/%d] -> ", i, p->localDepth);
+    for (int s = 0; s < p->count; s++)
+      printf("(%d,%d) ", p->keys[s], p->values[s]);
+    printf("\n");
+  }
+}
+
+static void eh_free(ts_hashmap_t *map)
+{
+  eh_table_t *t = map->impl;
+  // Backwards, so each page is freed at its first entry, after all others
+  for (unsigned int i = 1u << t->globalDepth; i-- > 0; )
+  {
+    eh_page_t *p = t->dir[i];
+    if (i >= (1u << p->localDepth))
+      continue;
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+  }
+  pthread_rwlock_destroy(&t->dirLock);
+  free(t->dir);
+  free(t);
+}
+
+/**
+ * Probe length is the key's position in its page plus one; it never
+ * exceeds EH_PAGE_SLOTS.
+ */
+static void eh_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  eh_table_t *t = map->impl;
+  long totalProbe = 0;
+  int entries = 0;
+
+  pthread_rwlock_wrlock(&t->dirLock);
+  for (unsigned int i = 0; i < (1u << t->globalDepth); i++)
+  {
+    eh_page_t *p = t->dir[i];
+    if (i >= (1u << p->localDepth))
+      continue;
+    for (int s = 0; s < p->count; s++)
+      totalProbe += s + 1;
+    entries += p->count;
+    if (p->count > stats->maxProbe)
+      stats->maxProbe = p->count;
+  }
+  stats->capacity = t->pages * EH_PAGE_SLOTS;
+  pthread_rwlock_unlock(&t->dirLock);
+
+  if (entries > 0)
+    stats->meanProbe = (double)totalProbe / entries;
+}
+
+const ts_ops_t ts_extendible_ops = {
+  .init = eh_init,
+  .get = eh_get,
+  .put = eh_put,
+  .del = eh_del,
+  .print = eh_print,
+  .free = eh_free,
+  .stats = eh_stats,
+};
@@ -0,0 +1,57 @@
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+#include "ts_hash.h"
+
+static const char *hashNames[TS_NUM_HASHES] = {
+  [TS_HASH_IDENTITY] = "identity",
+  [TS_HASH_MURMUR] = "murmur",
+  [TS_HASH_WYHASH] = "wyhash",
+  [TS_HASH_FIBONACCI] = "fibonacci",
+  [TS_HASH_SIPHASH] = "siphash",
+};
+
+/**
+ * Returns the short name of a hash function, as accepted by ts_hash_parse()
+ */
+const char *ts_hash_name(ts_hash_t kind)
+{
+  return hashNames[kind];
+}
+
+/**
+ * Looks up a hash function by its short name
+ * @param name a name such as "murmur" or "fibonacci"
+ * @param kind where to store the matching function
+ * @return 0 on success, or -1 if no function has that name
+ */
+int ts_hash_parse(const char *name, ts_hash_t *kind)
+{
+  for (int i = 0; i < TS_NUM_HASHES; i++)
+  {
+    if (strcmp(name, hashNames[i]) == 0)
+    {
+      *kind = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Draws a random 64-bit seed from the kernel, or from the clock and the
+ * stack address if it has no entropy to give yet
+ */
+unsigned long long ts_hash_seed(void)
+{
+  unsigned long long seed;
+  if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == sizeof(seed))
+    return seed;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  seed = (now.tv_sec * 1000000000ull + now.tv_nsec) ^ (unsigned long)&seed;
+  seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull; // splitmix64's finalizer
+  seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+  return seed ^ (seed >> 31);
+}
@@ -0,0 +1,110 @@
+#ifndef TS_HASH_H_
+#define TS_HASH_H_
+
+// Hash functions for the chained table's bucket index, chosen per map
+// through ts_config_t.hash. The identity keeps the original key % capacity.
+// The others mix the key into a 32-bit hash, and the index is then the
+// hash's position in the bucket range, (hash * capacity) >> 32: a multiply
+// and a shift instead of a division, for any capacity, and the plain top
+// bits of the hash when the capacity is a power of two.
+//
+// SipHash is keyed with a random secret per map, so without the secret no
+// one can pick keys that pile into one bucket. The chained table also
+// reseeds it and rehashes once a chain grows far past what the load
+// explains (see put_bucket()).
+
+typedef enum ts_hash_t {
+   TS_HASH_IDENTITY = 0, // the key itself, reduced by key % capacity
+   TS_HASH_MURMUR,       // murmur3's 32-bit finalizer
+   TS_HASH_WYHASH,       // wyhash's 64x64 -> 128-bit multiply, folded
+   TS_HASH_FIBONACCI,    // one multiply by 2^32 / golden ratio; mixes the top bits only
+   TS_HASH_SIPHASH,      // SipHash-1-3 under a random 128-bit key
+   TS_NUM_HASHES
+} ts_hash_t;
+
+const char *ts_hash_name(ts_hash_t);
+int ts_hash_parse(const char*, ts_hash_t*);
+unsigned long long ts_hash_seed(void);
+
+static inline unsigned int ts_hash_murmur(unsigned int h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static inline unsigned int ts_hash_wyhash(unsigned int key)
+{
+  unsigned __int128 r = (unsigned __int128)(key ^ 0xa0761d6478bd642full) * 0xe7037ed1a0b428dbull;
+  unsigned long long folded = (unsigned long long)r ^ (unsigned long long)(r >> 64);
+  return (unsigned int)(folded ^ (folded >> 32));
+}
+
+static inline unsigned int ts_hash_fibonacci(unsigned int key)
+{
+  return key * 0x9e3779b9u;
+}
+
+#define TS_SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define TS_SIP_ROUND(v0, v1, v2, v3) \
+  do { \
+    v0 += v1; v1 = TS_SIP_ROTL(v1, 13); v1 ^= v0; v0 = TS_SIP_ROTL(v0, 32); \
+    v2 += v3; v3 = TS_SIP_ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = TS_SIP_ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = TS_SIP_ROTL(v1, 17); v1 ^= v2; v2 = TS_SIP_ROTL(v2, 32); \
+  } while (0)
+
+/**
+ * SipHash-1-3 of the key's four bytes under secret. The message fits in
+ * the final block with its length, so this is one compression round and
+ * three finalization rounds.
+ */
+static inline unsigned long long ts_siphash(const unsigned long long secret[2], unsigned int key)
+{
+  unsigned long long v0 = secret[0] ^ 0x736f6d6570736575ull;
+  unsigned long long v1 = secret[1] ^ 0x646f72616e646f6dull;
+  unsigned long long v2 = secret[0] ^ 0x6c7967656e657261ull;
+  unsigned long long v3 = secret[1] ^ 0x7465646279746573ull;
+  unsigned long long m = key | (4ull << 56);
+
+  v3 ^= m;
+  TS_SIP_ROUND(v0, v1, v2, v3);
+  v0 ^= m;
+  v2 ^= 0xff;
+  TS_SIP_ROUND(v0, v1, v2, v3);
+  TS_SIP_ROUND(v0, v1, v2, v3);
+  TS_SIP_ROUND(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * Hashes key with one of the unkeyed functions; SipHash goes through
+ * ts_siphash() with its secret
+ */
+static inline unsigned int ts_hash(ts_hash_t kind, int key)
+{
+  switch (kind)
+  {
+  case TS_HASH_MURMUR:
+    return ts_hash_murmur((unsigned int)key);
+  case TS_HASH_WYHASH:
+    return ts_hash_wyhash((unsigned int)key);
+  case TS_HASH_FIBONACCI:
+    return ts_hash_fibonacci((unsigned int)key);
+  default:
+    return (unsigned int)key;
+  }
+}
+
+/**
+ * Maps a hash onto [0, n) by its high bits (Lemire's fastrange)
+ */
+static inline unsigned int ts_fastrange(unsigned int h, unsigned int n)
+{
+  return (unsigned int)(((unsigned long long)h * n) >> 32);
+}
+
+#endif /* TS_HASH_H_ */
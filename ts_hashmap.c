@@ -3,31 +3,981 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "ts_hashmap.h"
+#include "ts_backend.h"
+#include "ts_ebr.h"
+#include "ts_hazard.h"
+#include "ts_tree.h"
+
+// Backends indexed by ts_backend_t. The chained table has no ops entry;
+// it is the code in this file.
+static const ts_ops_t *backends[TS_NUM_BACKENDS] = {
+  [TS_CHAINED] = NULL,
+  [TS_OPEN_ADDRESSING] = &ts_oa_ops,
+  [TS_ROBIN_HOOD] = &ts_rh_ops,
+  [TS_SWISS] = &ts_swiss_ops,
+  [TS_CUCKOO] = &ts_cuckoo_ops,
+  [TS_HOPSCOTCH] = &ts_hopscotch_ops,
+  [TS_SPLIT_ORDER] = &ts_splitorder_ops,
+  [TS_EXTENDIBLE] = &ts_extendible_ops,
+  [TS_LOCK_FREE] = &ts_lockfree_ops,
+  [TS_COMPACT] = &ts_compact_ops,
+  [TS_INLINE] = &ts_inline_ops,
+};
+
+static const char *backendNames[TS_NUM_BACKENDS] = {
+  [TS_CHAINED] = "chained",
+  [TS_OPEN_ADDRESSING] = "oa",
+  [TS_ROBIN_HOOD] = "robinhood",
+  [TS_SWISS] = "swiss",
+  [TS_CUCKOO] = "cuckoo",
+  [TS_HOPSCOTCH] = "hopscotch",
+  [TS_SPLIT_ORDER] = "splitorder",
+  [TS_EXTENDIBLE] = "extendible",
+  [TS_LOCK_FREE] = "lockfree",
+  [TS_COMPACT] = "compact",
+  [TS_INLINE] = "inline",
+};
+
+#define TS_MAX_LOAD 0.75     // default entries per bucket before growing
+#define TS_MIN_LOAD 0.2      // default entries per bucket before shrinking
+#define TS_MIGRATE_STEP 4    // buckets each call claims while a resize runs
+#define TS_MIGRATE_LONG 8    // chains a bucket's move can leave for treeify() to fix
+#define TS_STRIPES_PER_CORE 4
+#define TS_READ_TRIES 4      // default optimistic attempts before get() takes the lock
+#define TS_MAX_SHARDS 64     // counter shards per map, at most
+#define TS_BATCH_GROUP 16    // keys of a batch whose buckets are prefetched together
+#define TS_WRITE_CHUNK 512   // keys of a put or del batch sorted by stripe at a time
+#define TS_LONG_CHAIN 16     // chain put() adds to, beyond 4 per unit of load, that sets off a reseed
+#define TS_TREEIFY 8         // default chain length past which a bucket becomes a tree
+#define HP_TABLE 0           // hazard slots: two to step down table generations,
+#define HP_ENTRY 2           // one for the entry get() is reading
+
+// One generation of the chained table. A resize hangs the next generation
+// off next; every operation then claims a few buckets and moves them over,
+// leaving TS_MOVED behind, and whoever moves the last bucket makes next the
+// map's table. A bucket only changes under its own lock, and the key's
+// bucket has the same lock in every generation, so an operation that finds
+// TS_MOVED just follows next while holding that lock.
+typedef struct ts_table_t {
+  int capacity;
+  unsigned long long seed;     // TS_HASH_SIPHASH: places keys within their stripe
+  int transferIndex;           // next bucket to hand to a helper
+  int migrated;                // buckets helpers have finished
+  int stalled;                 // a helper ran out of memory before moving its buckets
+  struct ts_table_t *next;     // NULL unless resizing
+  ts_entry_t *buckets[];
+} ts_table_t;
+
+// Forwarding marker left in buckets that have moved to the next table
+static ts_entry_t movedMarker;
+#define TS_MOVED (&movedMarker)
+
+// A bucket whose chain grew past map->treeify entries holds a tree of
+// them instead (ts_tree.h), its head pointing at the ts_tree_t with the
+// low bit set. The tree turns back into a chain once it shrinks to three
+// quarters of that.
+#define TS_TREE_BIT 1ul
+
+static inline int is_tree(ts_entry_t *head)
+{
+  return ((unsigned long)head & TS_TREE_BIT) != 0;
+}
+
+static inline ts_tree_t *as_tree(ts_entry_t *head)
+{
+  return (ts_tree_t *)((unsigned long)head & ~TS_TREE_BIT);
+}
+
+static inline ts_entry_t *tree_head(ts_tree_t *tree)
+{
+  return (ts_entry_t *)((unsigned long)tree | TS_TREE_BIT);
+}
+
+// Each thread's counter shard index, handed out in turn on first use
+__thread int ts_shard_self = -1;
+static int nextShard = 0;
+static __thread unsigned int writesSinceCheck = 0;
+static __thread int longChain = 0;      // longest chain put() added to since after_op()
+
+/**
+ * Gives the calling thread the next counter shard index
+ */
+int ts_shard_assign(void)
+{
+  ts_shard_self = __atomic_fetch_add(&nextShard, 1, __ATOMIC_RELAXED) & (TS_MAX_SHARDS - 1);
+  return ts_shard_self;
+}
+
+/**
+ * Sums the map's size over its counter shards. Writers keep going
+ * meanwhile, so the result is approximate.
+ */
+long ts_count_size(ts_hashmap_t *map)
+{
+  long size = 0;
+  for (int i = 0; i < map->numCounters; i++)
+    size += __atomic_load_n(&map->counters[i].inserts, __ATOMIC_RELAXED) -
+            __atomic_load_n(&map->counters[i].deletes, __ATOMIC_RELAXED);
+  return size;
+}
+
+/**
+ * Creates a new thread-safe hashmap.
+ *
+ * @param capacity initial capacity of the hashmap.
+ * @return a pointer to a new thread-safe hashmap.
+ */
+ts_hashmap_t *initmap(int capacity)
+{
+  ts_config_t config = { .capacity = capacity };
+  return initmap_config(&config);
+}
+
+/**
+ * Creates a new thread-safe hashmap with the given backend and options.
+ *
+ * @param config capacity and backend of the new map.
+ * @return a pointer to a new thread-safe hashmap, or NULL if the backend
+ *         could not allocate its storage.
+ */
+ts_hashmap_t *initmap_config(const ts_config_t *config)
+{
+  int capacity = config->capacity > 0 ? config->capacity : 1;
+  ts_hashmap_t *map = malloc(sizeof(ts_hashmap_t));
+  map->ops = backends[config->backend];
+  map->impl = NULL;
+
+  // A shard per core, so threads pinned apart never share one
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  map->numCounters = 1;
+  while (map->numCounters < cores && map->numCounters < TS_MAX_SHARDS)
+    map->numCounters *= 2;
+  map->counters = aligned_alloc(64, sizeof(ts_counters_t) * map->numCounters);
+  memset(map->counters, 0, sizeof(ts_counters_t) * map->numCounters);
+
+  if (map->ops != NULL)
+  {
+    map->table = NULL;
+    map->locks = NULL;
+    map->capacity = capacity;
+    if (map->ops->init(map, config) != 0)
+    {
+      free(map->counters);
+      free(map);
+      return NULL;
+    }
+    return map;
+  }
+
+  // Stripes are independent of the capacity; round the capacity up so
+  // that each stripe guards the same number of buckets
+  long stripes = config->stripes > 0 ? config->stripes : TS_STRIPES_PER_CORE * sysconf(_SC_NPROCESSORS_ONLN);
+  if (stripes < 1 || stripes > capacity)
+    stripes = capacity;
+  long rounded = (capacity + stripes - 1) / stripes * stripes;
+  if (rounded > INT_MAX)
+    stripes = capacity;
+  else
+    capacity = rounded;
+
+  map->table = calloc(1, sizeof(ts_table_t) + sizeof(ts_entry_t *) * capacity);
+  map->locks = aligned_alloc(64, sizeof(ts_stripe_t) * stripes);
+
+  for (int i = 0; i < capacity; i++)   // Initialize all lists to null
+    map->table->buckets[i] = NULL;
+  for (int i = 0; i < stripes; i++)
+  {
+    ts_lock_init(&map->locks[i].lock, config->lock);
+    map->locks[i].version = 0;
+  }
+
+  map->table->capacity = capacity;
+  map->capacity = capacity;
+  map->numLocks = stripes;
+  map->minCapacity = capacity;
+  map->lockKind = config->lock;
+  map->readTries = config->readTries != 0 ? config->readTries : TS_READ_TRIES;
+  map->reclaim = config->reclaim;
+  map->hash = config->hash;
+  map->secret[0] = ts_hash_seed();
+  map->secret[1] = ts_hash_seed();
+  map->table->seed = ts_hash_seed();
+  ts_slab_pool_init(&map->entries, sizeof(ts_entry_t));
+  ts_slab_pool_init(&map->treeNodes, sizeof(ts_tree_node_t));
+  map->treeify = config->treeify != 0 ? config->treeify : TS_TREEIFY;
+  map->trees = 0;
+  map->maxLoad = config->maxLoad != 0 ? config->maxLoad : TS_MAX_LOAD;
+  map->minLoad = config->minLoad != 0 ? config->minLoad : TS_MIN_LOAD;
+
+  return map;
+}
+
+/**
+ * Starts an operation's reads of tables and entries that may be retired
+ * meanwhile. Hazard pointers need nothing here; they protect each node as
+ * it is reached.
+ */
+static inline void reclaim_begin(ts_hashmap_t *map)
+{
+  if (map->reclaim == TS_RECLAIM_EBR)
+    ts_ebr_enter();
+}
+
+static inline void reclaim_end(ts_hashmap_t *map)
+{
+  if (map->reclaim == TS_RECLAIM_EBR)
+    ts_ebr_exit();
+  else
+    ts_hp_clear();
+}
+
+/**
+ * Frees p with destroy (free() if NULL) once no operation can still be
+ * reading it
+ */
+static inline void reclaim_retire(ts_hashmap_t *map, void *p, void (*destroy)(void *))
+{
+  if (map->reclaim == TS_RECLAIM_EBR)
+    ts_ebr_retire(p, destroy);
+  else
+    ts_hp_retire(p, destroy);
+}
+
+/**
+ * Loads the map's current table, protected in the given hazard slot
+ */
+static inline ts_table_t *current_table(ts_hashmap_t *map, int slot)
+{
+  if (map->reclaim == TS_RECLAIM_HAZARD)
+    return ts_hp_protect(slot, (void **)&map->table);
+  return __atomic_load_n(&map->table, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Steps from t, protected in *slot, to the next table generation, which
+ * takes the other table slot. A table is only retired after the one
+ * following it became the map's table, so next is safe as long as the
+ * map's table is still t or next once next has been published.
+ * @return t->next, or NULL if the map moved past it and the caller has to
+ *         start over from the map's table
+ */
+static ts_table_t *next_table(ts_hashmap_t *map, ts_table_t *t, int *slot)
+{
+  ts_table_t *next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+  if (map->reclaim == TS_RECLAIM_HAZARD)
+  {
+    *slot ^= 1;
+    ts_hp_set(*slot, next);
+    ts_table_t *current = __atomic_load_n(&map->table, __ATOMIC_ACQUIRE);
+    if (current != t && current != next)
+      return NULL;
+  }
+  return next;
+}
+
+/**
+ * Hashes key with the map's function: the key itself under the identity,
+ * a 32-bit mix, or SipHash's 64 bits under the map's secret. An operation
+ * hashes its key once and finds both its stripe and its bucket from that.
+ */
+static inline unsigned long long key_hash(ts_hashmap_t *map, int key)
+{
+  if (map->hash == TS_HASH_IDENTITY)
+    return (unsigned int)key;
+  if (map->hash == TS_HASH_SIPHASH)
+    return ts_siphash(map->secret, key);
+  return ts_hash(map->hash, key);
+}
+
+/**
+ * Maps a key's hash onto [0, n): by key % n under the identity hash, else
+ * by the position of the hash in the range, as ts_hash.h describes.
+ * SipHash contributes the high half of its 64 bits, which only pick the
+ * stripe.
+ */
+static inline unsigned int hash_index(ts_hashmap_t *map, unsigned long long h, unsigned int n)
+{
+  if (map->hash == TS_HASH_IDENTITY)
+    return ((unsigned int)h) % n;
+  if (map->hash == TS_HASH_SIPHASH)
+    return ts_fastrange(h >> 32, n);
+  return ts_fastrange(h, n);
+}
+
+/**
+ * The bucket in table generation t of the key hashing to h. Under
+ * SipHash the map's secret picks the key's stripe, as for locking, and
+ * the table's seed its bucket among that stripe's contiguous range, so a
+ * reseeded table of the same capacity scatters the keys of a chain while
+ * each stays under its lock.
+ */
+static inline unsigned int bucket_index(ts_hashmap_t *map, ts_table_t *t, unsigned long long h)
+{
+  if (map->hash != TS_HASH_SIPHASH)
+    return hash_index(map, h, t->capacity);
+
+  unsigned int perStripe = t->capacity / map->numLocks;
+  unsigned long long mixed = h ^ t->seed; // splitmix64's finalizer, a bijection
+  mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ull;
+  mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebull;
+  mixed ^= mixed >> 31;
+  return ts_fastrange(h >> 32, map->numLocks) * perStripe + ts_fastrange(mixed >> 32, perStripe);
+}
+
+/**
+ * The stripe guarding the bucket of the key hashing to h, in every table
+ * generation
+ */
+static inline ts_stripe_t *hash_stripe(ts_hashmap_t *map, unsigned long long h)
+{
+  return &map->locks[hash_index(map, h, map->numLocks)];
+}
+
+/**
+ * The stripe guarding bucket i of t. Under the identity hash, the buckets
+ * of a stripe are those equal to it modulo numLocks; under a mixing hash,
+ * each stripe has a contiguous 1/numLocks of the range. Either way the
+ * capacity being a multiple of numLocks makes this the stripe of every
+ * key in the bucket, and keeps it when the capacity doubles or halves.
+ */
+static inline ts_stripe_t *bucket_stripe(ts_hashmap_t *map, ts_table_t *t, int i)
+{
+  if (map->hash == TS_HASH_IDENTITY)
+    return &map->locks[i % map->numLocks];
+  return &map->locks[i / (t->capacity / map->numLocks)];
+}
+
+/**
+ * Finds the table generation holding the key hashing to h: the first
+ * one, starting from the map's table, whose bucket for it has not moved
+ * on.
+ * @return the key's bucket
+ */
+static ts_entry_t **find_bucket(ts_hashmap_t *map, unsigned long long h)
+{
+  int slot = HP_TABLE;
+  ts_table_t *t = current_table(map, slot);
+  ts_entry_t **bucket = &t->buckets[bucket_index(map, t, h)];
+  while (__atomic_load_n(bucket, __ATOMIC_ACQUIRE) == TS_MOVED)
+  {
+    ts_table_t *next = next_table(map, t, &slot);
+    t = (next != NULL) ? next : current_table(map, slot);
+    bucket = &t->buckets[bucket_index(map, t, h)];
+  }
+  return bucket;
+}
+
+/**
+ * Frees an entry or tree node once no optimistic get() can still be on it
+ */
+static inline void retire_node(ts_hashmap_t *map, void *node)
+{
+  ts_slab_hold(node);
+  reclaim_retire(map, node, ts_slab_release);
+}
+
+/**
+ * Adds a node holding key and value to tree, which does not hold key yet
+ * @return 0, or -1 if no node could be allocated
+ */
+static int tree_add(ts_hashmap_t *map, ts_tree_t *tree, int key, int value)
+{
+  ts_tree_node_t *node = ts_slab_alloc(&map->treeNodes);
+  if (node == NULL)
+    return -1;
+  node->key = key;
+  node->value = value;
+  ts_tree_insert(tree, node);
+  return 0;
+}
+
+/**
+ * Frees a node of a tree no reader has seen; a ts_tree_walk() visitor
+ */
+static void free_tree_node(ts_tree_node_t *node, int depth, void *arg)
+{
+  ts_slab_free(node);
+}
+
+/**
+ * Replaces the chain in bucket, which the caller has locked for writing,
+ * with a tree of the same pairs. Short of memory, it leaves the chain,
+ * which still works, only slower.
+ */
+static void treeify(ts_hashmap_t *map, ts_entry_t **bucket)
+{
+  ts_tree_t *tree = malloc(sizeof(ts_tree_t));
+  if (tree == NULL)
+    return;
+  tree->root = NULL;
+  tree->count = 0;
+  ts_entry_t *entry = *bucket;
+  for (ts_entry_t *e = entry; e != NULL; e = e->next)
+  {
+    if (tree_add(map, tree, e->key, e->value) < 0)
+    {
+      ts_tree_walk(tree, free_tree_node, NULL);
+      free(tree);
+      return;
+    }
+  }
+  __atomic_store_n(bucket, tree_head(tree), __ATOMIC_RELEASE);
+  __atomic_fetch_add(&map->trees, 1, __ATOMIC_RELAXED);
+
+  while (entry != NULL)
+  {
+    ts_entry_t *following = entry->next;
+    retire_node(map, entry);
+    entry = following;
+  }
+}
+
+// What the tree walks below carry along
+typedef struct tree_walk_t {
+  ts_hashmap_t *map;
+  ts_entry_t *chain;           // chain_node(): the chain built so far
+  int failed;                  // chain_node(): an entry could not be allocated
+} tree_walk_t;
+
+/**
+ * Retires a tree node; a ts_tree_walk() visitor
+ */
+static void retire_tree_node(ts_tree_node_t *node, int depth, void *arg)
+{
+  retire_node(((tree_walk_t *)arg)->map, node);
+}
+
+/**
+ * Retires every node of tree and then tree itself, once no bucket leads
+ * to it any more
+ */
+static void retire_tree(ts_hashmap_t *map, ts_tree_t *tree)
+{
+  tree_walk_t walk = { .map = map };
+  ts_tree_walk(tree, retire_tree_node, &walk);
+  reclaim_retire(map, tree, NULL);
+}
+
+/**
+ * Copies a tree node's pair onto the front of the chain being built; a
+ * ts_tree_walk() visitor
+ */
+static void chain_node(ts_tree_node_t *node, int depth, void *arg)
+{
+  tree_walk_t *walk = arg;
+  ts_entry_t *entry = walk->failed ? NULL : ts_slab_alloc(&walk->map->entries);
+  if (entry == NULL)
+  {
+    walk->failed = 1;
+    return;
+  }
+  entry->key = node->key;
+  entry->value = node->value;
+  entry->next = walk->chain;
+  walk->chain = entry;
+}
+
+/**
+ * Replaces tree, in bucket, which the caller has locked for writing, with
+ * a chain of the same pairs. Short of memory, it leaves the tree.
+ */
+static void untreeify(ts_hashmap_t *map, ts_entry_t **bucket, ts_tree_t *tree)
+{
+  tree_walk_t walk = { .map = map, .chain = NULL, .failed = 0 };
+  ts_tree_walk(tree, chain_node, &walk);
+  if (walk.failed)
+  {
+    while (walk.chain != NULL)
+    {
+      ts_entry_t *following = walk.chain->next;
+      ts_slab_free(walk.chain);
+      walk.chain = following;
+    }
+    return;
+  }
+  __atomic_store_n(bucket, walk.chain, __ATOMIC_RELEASE);
+  __atomic_fetch_sub(&map->trees, 1, __ATOMIC_RELAXED);
+  retire_tree(map, tree);
+}
+
+// A bucket on its way to the next table. A pair going into a bucket of
+// the other kind needs a new entry or tree node; those are all set aside
+// before anything moves, so that the move cannot run out of memory
+// halfway. For that count to hold, no bucket changes kind meanwhile:
+// chains the move makes too long are only noted, and treeified after.
+typedef struct migrate_t {
+  ts_hashmap_t *map;
+  ts_table_t *table;           // the table moved to
+  int entriesNeeded;           // for tree nodes going into chains
+  int nodesNeeded;             // for entries going into trees
+  ts_entry_t *entries;         // set aside, linked through next
+  ts_tree_node_t *nodes;       // set aside, linked through left
+  int numLong;
+  ts_entry_t **longChains[TS_MIGRATE_LONG];
+} migrate_t;
+
+/**
+ * The bucket of m->table that key moves to
+ */
+static inline ts_entry_t **migrate_target(migrate_t *m, int key)
+{
+  return &m->table->buckets[bucket_index(m->map, m->table, key_hash(m->map, key))];
+}
+
+/**
+ * Counts a tree node bound for a chain; a ts_tree_walk() visitor
+ */
+static void count_node(ts_tree_node_t *node, int depth, void *arg)
+{
+  migrate_t *m = arg;
+  if (!is_tree(*migrate_target(m, node->key)))
+    m->entriesNeeded++;
+}
+
+/**
+ * Frees whatever set_aside() allocated that the move did not use
+ */
+static void release_aside(migrate_t *m)
+{
+  while (m->entries != NULL)
+  {
+    ts_entry_t *following = m->entries->next;
+    ts_slab_free(m->entries);
+    m->entries = following;
+  }
+  while (m->nodes != NULL)
+  {
+    ts_tree_node_t *following = m->nodes->left;
+    ts_slab_free(m->nodes);
+    m->nodes = following;
+  }
+}
+
+/**
+ * Allocates the entries and tree nodes that moving the bucket whose head
+ * is head will need. Only a map with trees can send an entry into one.
+ * @return 0, or -1 if memory ran out, with nothing left allocated
+ */
+static int set_aside(migrate_t *m, ts_entry_t *head)
+{
+  if (is_tree(head))
+  {
+    ts_tree_walk(as_tree(head), count_node, m);
+  }
+  else if (__atomic_load_n(&m->map->trees, __ATOMIC_RELAXED) > 0)
+  {
+    for (ts_entry_t *e = head; e != NULL; e = e->next)
+    {
+      if (is_tree(*migrate_target(m, e->key)))
+        m->nodesNeeded++;
+    }
+  }
+
+  for (int k = 0; k < m->entriesNeeded; k++)
+  {
+    ts_entry_t *entry = ts_slab_alloc(&m->map->entries);
+    if (entry == NULL)
+    {
+      release_aside(m);
+      return -1;
+    }
+    entry->next = m->entries;
+    m->entries = entry;
+  }
+  for (int k = 0; k < m->nodesNeeded; k++)
+  {
+    ts_tree_node_t *node = ts_slab_alloc(&m->map->treeNodes);
+    if (node == NULL)
+    {
+      release_aside(m);
+      return -1;
+    }
+    node->left = m->nodes;
+    m->nodes = node;
+  }
+  return 0;
+}
+
+/**
+ * Adds a pair, whose key it does not hold yet, to a bucket of the table
+ * being migrated to: into its tree, or onto its chain by relinking entry,
+ * or a set-aside entry if that is NULL. A chain that grows too long is
+ * noted for treeify().
+ */
+static void migrate_pair(migrate_t *m, ts_entry_t **bucket, int key, int value, ts_entry_t *entry)
+{
+  ts_entry_t *head = *bucket;
+  if (is_tree(head))
+  {
+    ts_tree_node_t *node = m->nodes;
+    m->nodes = node->left;
+    node->key = key;
+    node->value = value;
+    ts_tree_insert(as_tree(head), node);
+    if (entry != NULL)
+      retire_node(m->map, entry);
+    return;
+  }
+
+  if (entry == NULL)
+  {
+    entry = m->entries;
+    m->entries = entry->next;
+    entry->key = key;
+    entry->value = value;
+  }
+  __atomic_store_n(&entry->next, head, __ATOMIC_RELEASE);
+  __atomic_store_n(bucket, entry, __ATOMIC_RELEASE);
+
+  if (m->map->treeify > 0 && m->numLong < TS_MIGRATE_LONG)
+  {
+    int length = 0;
+    for (ts_entry_t *e = entry; e != NULL && length <= m->map->treeify + 1; e = e->next)
+      length++;
+    if (length == m->map->treeify + 1) // Just grew too long
+      m->longChains[m->numLong++] = bucket;
+  }
+}
+
+/**
+ * Moves a tree node's pair into its bucket of the next table, relinking
+ * the node if that bucket is a tree; a ts_tree_walk() visitor
+ */
+static void migrate_node(ts_tree_node_t *node, int depth, void *arg)
+{
+  migrate_t *m = arg;
+  ts_entry_t **bucket = migrate_target(m, node->key);
+  if (is_tree(*bucket))
+  {
+    ts_tree_insert(as_tree(*bucket), node);
+  }
+  else
+  {
+    migrate_pair(m, bucket, node->key, node->value, NULL);
+    retire_node(m->map, node);
+  }
+}
+
+/**
+ * Moves every pair of bucket i of t into t->next and leaves TS_MOVED.
+ * Entries and tree nodes are relinked where the target bucket is of
+ * their kind and copied where it is not. Caller holds the lock of
+ * bucket i.
+ * @return 1 if it moved the bucket, 0 if that was already done, or -1 if
+ *         memory ran out first, leaving the bucket where it was
+ */
+static int migrate_bucket(ts_hashmap_t *map, ts_table_t *t, int i)
+{
+  migrate_t m = { .map = map, .table = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE) };
+  ts_entry_t *entry = t->buckets[i];
+  if (entry == TS_MOVED)
+    return 0;
+  if (set_aside(&m, entry) < 0)
+    return -1;
+
+  if (is_tree(entry))
+  {
+    ts_tree_walk(as_tree(entry), migrate_node, &m);
+    __atomic_store_n(&t->buckets[i], TS_MOVED, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&map->trees, 1, __ATOMIC_RELAXED);
+    reclaim_retire(map, as_tree(entry), NULL);
+  }
+  else
+  {
+    while (entry != NULL)
+    {
+      ts_entry_t *following = entry->next;
+      migrate_pair(&m, migrate_target(&m, entry->key), entry->key, entry->value, entry);
+      entry = following;
+    }
+    __atomic_store_n(&t->buckets[i], TS_MOVED, __ATOMIC_RELEASE);
+  }
+
+  for (int k = 0; k < m.numLong; k++)
+    treeify(map, m.longChains[k]);
+  return 1;
+}
+
+/**
+ * Marks the start of a change that optimistic readers of stripe s must
+ * not see half done. Caller holds the stripe's lock.
+ */
+static inline void write_begin(ts_stripe_t *s)
+{
+  __atomic_store_n(&s->version, s->version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_end(ts_stripe_t *s)
+{
+  __atomic_store_n(&s->version, s->version + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Claims the next few unmoved buckets of t and moves them, one lock at a
+ * time. A helper that runs out of memory leaves the rest of its claim
+ * and sets t->stalled; once every bucket has been claimed, helpers then
+ * sweep t for buckets still to move. The caller that moves the last
+ * bucket installs t->next as the map's table.
+ */
+static void help_migrate(ts_hashmap_t *map, ts_table_t *t)
+{
+  int start = 0;
+  int end = t->capacity;
+  if (__atomic_load_n(&t->transferIndex, __ATOMIC_RELAXED) < t->capacity)
+  {
+    start = __atomic_fetch_add(&t->transferIndex, TS_MIGRATE_STEP, __ATOMIC_RELAXED);
+    end = start + TS_MIGRATE_STEP < t->capacity ? start + TS_MIGRATE_STEP : t->capacity;
+  }
+  else if (!__atomic_load_n(&t->stalled, __ATOMIC_RELAXED))
+  {
+    return;
+  }
+
+  int moved = 0;
+  for (int i = start; i < end; i++)
+  {
+    if (__atomic_load_n(&t->buckets[i], __ATOMIC_RELAXED) == TS_MOVED)
+      continue; // Swept up already
+    ts_stripe_t *s = bucket_stripe(map, t, i);
+    ts_lock(&s->lock, map->lockKind);
+    write_begin(s);
+    int done = migrate_bucket(map, t, i);
+    write_end(s);
+    ts_unlock(&s->lock, map->lockKind);
+    if (done < 0)
+    {
+      __atomic_store_n(&t->stalled, 1, __ATOMIC_RELAXED);
+      break;
+    }
+    moved += done;
+  }
+
+  if (moved > 0 && __atomic_add_fetch(&t->migrated, moved, __ATOMIC_ACQ_REL) == t->capacity)
+  {
+    // Operations that loaded t before the switch may still follow it to
+    // next, so it is freed only once they are done
+    ts_table_t *next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&map->capacity, next->capacity, __ATOMIC_RELAXED);
+    __atomic_store_n(&map->table, next, __ATOMIC_RELEASE);
+    reclaim_retire(map, t, NULL);
+  }
+}
+
+/**
+ * The capacity table t should be resized to, or 0 if its current one
+ * is fine
+ */
+static int resize_target(ts_hashmap_t *map, ts_table_t *t)
+{
+  long size = ts_count_size(map);
+
+  if (map->maxLoad > 0 && size > t->capacity * map->maxLoad && t->capacity <= INT_MAX / 2)
+    return t->capacity * 2;
+  if (map->minLoad > 0 && size < t->capacity * map->minLoad && t->capacity > map->minCapacity)
+    return t->capacity / 2;
+  return 0;
+}
+
+/**
+ * Hangs an empty table of the given capacity off t, unless another thread
+ * already started resizing t. t stays current until it has been
+ * migrated, so a table that is no longer current always has a next one
+ * and the swap fails. Every generation gets a fresh seed.
+ * @return 1 if this call started the resize
+ */
+static int start_resize(ts_table_t *t, int capacity)
+{
+  ts_table_t *next = calloc(1, sizeof(ts_table_t) + sizeof(ts_entry_t *) * capacity);
+  ts_table_t *expected = NULL;
+  if (next == NULL)
+    return 0;
+
+  next->capacity = capacity;
+  next->seed = ts_hash_seed();
+  if (!__atomic_compare_exchange_n(&t->next, &expected, next, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+  {
+    free(next);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Rehashes t into a table of the same capacity, and so under a new seed,
+ * if the long chain a put() of this thread just added to is more than
+ * the load explains. With SipHash spreading the keys, a chain TS_LONG_CHAIN
+ * past four per unit of load essentially never happens by chance; it
+ * means someone learned the seed, say by timing, and is feeding the
+ * chain. The rehash runs through the usual incremental migration.
+ */
+static void check_long_chain(ts_hashmap_t *map, ts_table_t *t)
+{
+  long limit = TS_LONG_CHAIN + 4 * ts_count_size(map) / t->capacity;
+  if (longChain > limit && start_resize(t, t->capacity))
+    TS_COUNT(map, reseeds);
+  longChain = 0;
+}
+
+/**
+ * Locks the bucket of a key and finds it. Writers also start a version
+ * change on the stripe. The lock does not keep table generations from
+ * being retired by a resize that finishes meanwhile, so the operation
+ * reads them under the map's reclamation scheme.
+ * @param h key_hash() of the key
+ * @return the key's bucket
+ */
+static ts_entry_t **lock_key(ts_hashmap_t *map, unsigned long long h, int isWrite)
+{
+  ts_stripe_t *s = hash_stripe(map, h);
+  reclaim_begin(map);
+  ts_lock(&s->lock, map->lockKind);
+  if (isWrite)
+    write_begin(s);
+  return find_bucket(map, h);
+}
+
+/**
+ * Runs as every operation leaves: helps a running resize along, and
+ * writers start one if the load crossed a threshold or, under SipHash, a
+ * chain grew too long. Summing the size reads every counter shard, so
+ * each thread checks the load only every TS_LOAD_CHECK writes.
+ */
+static void after_op(ts_hashmap_t *map, int isWrite)
+{
+  ts_table_t *t = current_table(map, HP_TABLE);
+  if (__atomic_load_n(&t->next, __ATOMIC_ACQUIRE) != NULL)
+  {
+    longChain = 0; // The next generation has a seed of its own
+    help_migrate(map, t);
+  }
+  else if (isWrite && longChain > 0)
+  {
+    check_long_chain(map, t);
+  }
+  else if (isWrite && (++writesSinceCheck % TS_LOAD_CHECK) == 0)
+  {
+    int target = resize_target(map, t);
+    if (target != 0)
+      start_resize(t, target);
+  }
+}
 
 /**
- * Creates a new thread-safe hashmap.
- *
- * @param capacity initial capacity of the hashmap.
- * @return a pointer to a new thread-safe hashmap.
+ * Unlocks the bucket of the key hashing to h, ending a writer's version
+ * change
  */
-ts_hashmap_t *initmap(int capacity)
+static void unlock_key(ts_hashmap_t *map, unsigned long long h, int isWrite)
 {
-  ts_hashmap_t *map = malloc(sizeof(ts_hashmap_t));
-  map->table = malloc(sizeof(ts_entry_t *) * capacity);
-  map->locks = malloc(sizeof(pthread_mutex_t) * capacity);
+  ts_stripe_t *s = hash_stripe(map, h);
+  if (isWrite)
+    write_end(s);
+  ts_unlock(&s->lock, map->lockKind);
+  after_op(map, isWrite);
+  reclaim_end(map);
+}
 
-  for (int i = 0; i < capacity; i++)   // Initialize all lists to null
+/**
+ * get_optimistic() for a bucket holding a tree, which it goes down one
+ * node at a time the way a chain is walked one entry at a time
+ * @param before the stripe's version when the read started
+ */
+static int get_tree_optimistic(ts_hashmap_t *map, ts_stripe_t *s, unsigned int before, ts_tree_t *tree, int key, int *value, int *walked)
+{
+  if (map->reclaim == TS_RECLAIM_HAZARD)
+  {
+    ts_hp_set(HP_ENTRY, tree);
+    if (__atomic_load_n(&s->version, __ATOMIC_RELAXED) != before)
+      return 0;
+  }
+  ts_tree_node_t *node = __atomic_load_n(&tree->root, __ATOMIC_ACQUIRE);
+  while (node != NULL)
   {
-    map->table[i] = NULL;
-    pthread_mutex_init(&map->locks[i], NULL);
+    if (map->reclaim == TS_RECLAIM_HAZARD)
+    {
+      ts_hp_set(HP_ENTRY, node);
+      if (__atomic_load_n(&s->version, __ATOMIC_RELAXED) != before)
+        return 0;
+    }
+    (*walked)++;
+    int nodeKey = __atomic_load_n(&node->key, __ATOMIC_RELAXED);
+    if (nodeKey == key)
+    {
+      *value = __atomic_load_n(&node->value, __ATOMIC_RELAXED);
+      break;
+    }
+    node = __atomic_load_n(key < nodeKey ? &node->left : &node->right, __ATOMIC_ACQUIRE);
+    // Rotations can send a racing reader round in circles too
+    if ((*walked & 63) == 0 && __atomic_load_n(&s->version, __ATOMIC_RELAXED) != before)
+      return 0;
   }
 
-  map->capacity = capacity;
-  map->size = 0;
-  map->numOps = 0;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->version, __ATOMIC_RELAXED) == before;
+}
 
-  return map;
+/**
+ * Looks key up without taking its stripe's lock. Under EBR the caller is
+ * in a section, so nothing it reaches is freed meanwhile; under hazard
+ * pointers each entry is protected before it is read. The stripe's
+ * version tells it afterwards whether what it read was consistent.
+ * @param h key_hash() of key
+ * @param value where to store the value, or INT_MAX if key was not found
+ * @param walked where to store the number of entries examined
+ * @return 1 if the read validated, 0 if a writer got in the way
+ */
+static int get_optimistic(ts_hashmap_t *map, int key, unsigned long long h, int *value, int *walked)
+{
+  ts_stripe_t *s = hash_stripe(map, h);
+  unsigned int before = __atomic_load_n(&s->version, __ATOMIC_ACQUIRE);
+  if (before & 1)
+    return 0;
+
+  ts_entry_t *entry = __atomic_load_n(find_bucket(map, h), __ATOMIC_ACQUIRE);
+  *value = INT_MAX;
+  *walked = 0;
+  if (is_tree(entry))
+    return get_tree_optimistic(map, s, before, as_tree(entry), key, value, walked);
+  while (entry != NULL)
+  {
+    if (map->reclaim == TS_RECLAIM_HAZARD)
+    {
+      // Unlinking the entry bumps the version first, so if the version
+      // still holds once the entry is published, a later scan sees it
+      ts_hp_set(HP_ENTRY, entry);
+      if (__atomic_load_n(&s->version, __ATOMIC_RELAXED) != before)
+        return 0;
+    }
+    (*walked)++;
+    if (__atomic_load_n(&entry->key, __ATOMIC_RELAXED) == key)
+    {
+      *value = __atomic_load_n(&entry->value, __ATOMIC_RELAXED);
+      break;
+    }
+    entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+    // Migration relinks entries, so a racing reader could follow a
+    // cycle; check now and then
+    if ((*walked & 63) == 0 && __atomic_load_n(&s->version, __ATOMIC_RELAXED) != before)
+      return 0;
+  }
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->version, __ATOMIC_RELAXED) == before;
+}
+
+/**
+ * Counts a finished get() that examined walked entries
+ */
+static inline void count_get(ts_hashmap_t *map, int value, int walked)
+{
+  ts_counters_t *c = ts_counters(map);
+  if (value != INT_MAX)
+    __atomic_fetch_add(&c->hits, 1, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_add(&c->misses, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&c->chainSteps, walked, __ATOMIC_RELAXED);
 }
 
 /**
@@ -38,52 +988,112 @@ ts_hashmap_t *initmap(int capacity)
  */
 int get(ts_hashmap_t *map, int key)
 {
-  int index = ((unsigned int)key) % map->capacity;
+  if (map->ops != NULL)
+    return map->ops->get(map, key);
+
+  unsigned long long h = key_hash(map, key);
   int returnVal;
+  int walked = 0;
+  reclaim_begin(map);
+  for (int attempt = 0; attempt < map->readTries; attempt++)
+  {
+    if (get_optimistic(map, key, h, &returnVal, &walked))
+    {
+      count_get(map, returnVal, walked);
+      after_op(map, 0);
+      reclaim_end(map);
+      return returnVal;
+    }
+  }
+  reclaim_end(map);
 
-  pthread_mutex_lock(&map->locks[index]); // Lock up this bucket
+  // Too much churn on this stripe: wait for the writers instead
+  ts_entry_t **bucket = lock_key(map, h, 0); // Lock up this bucket
 
-  ts_entry_t *entry = map->table[index];
+  ts_entry_t *entry = *bucket;
+  walked = 0;
+
+  if (is_tree(entry))
+  {
+    ts_tree_node_t *node = ts_tree_find(as_tree(entry), key, &walked);
+    returnVal = (node != NULL) ? node->value : INT_MAX;
+    count_get(map, returnVal, walked);
+    unlock_key(map, h, 0);
+    return returnVal;
+  }
 
   // Traverse the linked list
   while (entry != NULL)
   {
+    walked++;
     if (entry->key == key)
     {
-      map->numOps++;
       returnVal = entry->value;
-      pthread_mutex_unlock(&map->locks[index]); // Unlock the bucket after we have the value
+      count_get(map, returnVal, walked);
+      unlock_key(map, h, 0); // Unlock the bucket after we have the value
       return returnVal;
     }
     entry = entry->next;
   }
 
-  map->numOps++;
-  pthread_mutex_unlock(&map->locks[index]); // Unlock the bucket after searching is finished
+  count_get(map, INT_MAX, walked);
+  unlock_key(map, h, 0); // Unlock the bucket after searching is finished
   return INT_MAX; // Key not found
 }
 
 /**
- * Associates a value associated with a given key.
- * @param map a pointer to the map
- * @param key a key
- * @param value a value
- * @return old associated value, or INT_MAX if the key was new
+ * Under SipHash, notes a put() that left a bucket holding more than
+ * TS_LONG_CHAIN pairs, for after_op() to judge
  */
-int put(ts_hashmap_t *map, int key, int value)
+static inline void note_chain(ts_hashmap_t *map, int length)
+{
+  if (length > TS_LONG_CHAIN && length > longChain && map->hash == TS_HASH_SIPHASH)
+    longChain = length;
+}
+
+/**
+ * put_bucket() for a bucket holding a tree
+ */
+static int put_tree(ts_hashmap_t *map, ts_tree_t *tree, int key, int value)
+{
+  ts_tree_node_t *node = ts_tree_find(tree, key, NULL);
+  if (node != NULL)
+  {
+    int temp = node->value;
+    __atomic_store_n(&node->value, value, __ATOMIC_RELAXED);
+    TS_COUNT(map, updates);
+    return temp;
+  }
+
+  if (tree_add(map, tree, key, value) < 0)
+    return TS_PUT_FAILED;
+  note_chain(map, tree->count);
+  TS_COUNT(map, inserts);
+  return INT_MAX;
+}
+
+/**
+ * Stores value under key in bucket, which the caller has locked for
+ * writing. A chain that grows past map->treeify entries becomes a tree.
+ * @return old associated value, INT_MAX if the key was new, or
+ *         TS_PUT_FAILED if it was new and memory ran out
+ */
+static int put_bucket(ts_hashmap_t *map, ts_entry_t **bucket, int key, int value)
 {
-  int index = ((unsigned int)key) % map->capacity;
-  pthread_mutex_lock(&map->locks[index]); // Lock up this bucket
-  ts_entry_t *entry = map->table[index];
+  ts_entry_t *entry = *bucket;
+  int walked = 0;
+
+  if (is_tree(entry))
+    return put_tree(map, as_tree(entry), key, value);
 
   while (entry != NULL) // Traverse the linked list
   {
+    walked++;
     if (entry->key == key) // Key exists, replace the value
     {
       int temp = entry->value;
-      entry->value = value;
-      map->numOps++;
-      pthread_mutex_unlock(&map->locks[index]); // unlock this bucket
+      __atomic_store_n(&entry->value, value, __ATOMIC_RELAXED);
+      TS_COUNT(map, updates);
       return temp;
     }
     if (entry->next == NULL)
@@ -94,40 +1104,82 @@ int put(ts_hashmap_t *map, int key, int value)
   }
 
   // Key not found, create a new entry
-  ts_entry_t *entry2 = malloc(sizeof(ts_entry_t));
+  ts_entry_t *entry2 = ts_slab_alloc(&map->entries);
+  if (entry2 == NULL)
+    return TS_PUT_FAILED;
   entry2->key = key;
   entry2->value = value;
   entry2->next = NULL;
 
   if (entry == NULL)
   {
-    map->table[index] = entry2; // Empty list, this is the first element
+    __atomic_store_n(bucket, entry2, __ATOMIC_RELEASE); // Empty list, this is the first element
   }
   else
   {
-    entry->next = entry2; // We're adding to this linked list
+    __atomic_store_n(&entry->next, entry2, __ATOMIC_RELEASE); // We're adding to this linked list
   }
 
-  map->size++;
-  map->numOps++;
-  pthread_mutex_unlock(&map->locks[index]); // unlock this bucket
+  if (map->treeify > 0 && walked + 1 > map->treeify)
+    treeify(map, bucket);
+  note_chain(map, walked + 1);
+  TS_COUNT(map, inserts);
   return INT_MAX;
 }
 
 /**
- * Removes an entry in the map
+ * Associates a value associated with a given key.
  * @param map a pointer to the map
- * @param key a key to search
- * @return the value associated with the given key, or INT_MAX if key not found
+ * @param key a key
+ * @param value a value
+ * @return old associated value, INT_MAX if the key was new, or
+ *         TS_PUT_FAILED if it could not be stored
  */
-int del(ts_hashmap_t *map, int key)
+int put(ts_hashmap_t *map, int key, int value)
+{
+  if (map->ops != NULL)
+    return map->ops->put(map, key, value);
+
+  unsigned long long h = key_hash(map, key);
+  ts_entry_t **bucket = lock_key(map, h, 1); // Lock up this bucket
+  int returnVal = put_bucket(map, bucket, key, value);
+  unlock_key(map, h, 1); // unlock this bucket
+  return returnVal;
+}
+
+/**
+ * del_bucket() for a bucket holding a tree, which goes back to a chain
+ * once it is down to three quarters of map->treeify
+ */
+static int del_tree(ts_hashmap_t *map, ts_entry_t **bucket, ts_tree_t *tree, int key)
 {
+  ts_tree_node_t *node = ts_tree_remove(tree, key);
+  if (node == NULL)
+  {
+    TS_COUNT(map, delMisses);
+    return INT_MAX;
+  }
+
+  int temp = node->value;
+  retire_node(map, node);
+  if (tree->count <= map->treeify * 3 / 4)
+    untreeify(map, bucket, tree);
+  TS_COUNT(map, deletes);
+  return temp;
+}
 
-  int index = ((unsigned int)key) % map->capacity;
-  pthread_mutex_lock(&map->locks[index]); // Lock up this bucket
-  ts_entry_t *entry = map->table[index];
+/**
+ * Removes key from bucket, which the caller has locked for writing
+ * @return the value associated with the given key, or INT_MAX if key not found
+ */
+static int del_bucket(ts_hashmap_t *map, ts_entry_t **bucket, int key)
+{
+  ts_entry_t *entry = *bucket;
   ts_entry_t *prev = NULL;
 
+  if (is_tree(entry))
+    return del_tree(map, bucket, as_tree(entry), key);
+
   while (entry != NULL)
   {
     if (entry->key == key) // Found the entry for deletion!
@@ -136,17 +1188,15 @@ int del(ts_hashmap_t *map, int key)
 
       if (prev == NULL) // First item in the list
       {
-        map->table[index] = entry->next;
+        __atomic_store_n(bucket, entry->next, __ATOMIC_RELEASE);
       }
       else // In the middle or end of the list
       {
-        prev->next = entry->next;
+        __atomic_store_n(&prev->next, entry->next, __ATOMIC_RELEASE);
       }
 
-      free(entry);
-      map->size--;
-      map->numOps++;
-      pthread_mutex_unlock(&map->locks[index]); // Unlock bucket
+      retire_node(map, entry);
+      TS_COUNT(map, deletes);
       return temp;
     }
 
@@ -155,20 +1205,236 @@ int del(ts_hashmap_t *map, int key)
   }
 
   // Key not found
-  map->numOps++;
-  pthread_mutex_unlock(&map->locks[index]); // Unlock bucket
+  TS_COUNT(map, delMisses);
   return INT_MAX;
 }
 
 /**
- * Prints the contents of the map (given)
+ * Removes an entry in the map
+ * @param map a pointer to the map
+ * @param key a key to search
+ * @return the value associated with the given key, or INT_MAX if key not found
  */
-void printmap(ts_hashmap_t *map)
+int del(ts_hashmap_t *map, int key)
+{
+  if (map->ops != NULL)
+    return map->ops->del(map, key);
+
+  unsigned long long h = key_hash(map, key);
+  ts_entry_t **bucket = lock_key(map, h, 1); // Lock up this bucket
+  int returnVal = del_bucket(map, bucket, key);
+  unlock_key(map, h, 1); // Unlock bucket
+  return returnVal;
+}
+
+/**
+ * Starts loading what a lookup of each of n keys will read: the bucket
+ * heads first, then, once those are on their way, the first entry of
+ * each bucket. Prefetches never fault, so a stale pointer costs nothing
+ * but the wasted load.
+ */
+static void prefetch_keys(ts_hashmap_t *map, const int *keys, int n)
+{
+  if (map->ops != NULL)
+  {
+    if (map->ops->prefetch != NULL)
+    {
+      for (int i = 0; i < n; i++)
+        map->ops->prefetch(map, keys[i]);
+    }
+    return;
+  }
+
+  ts_entry_t **heads[TS_BATCH_GROUP];
+  reclaim_begin(map);
+  ts_table_t *t = current_table(map, HP_TABLE);
+  for (int i = 0; i < n; i++)
+  {
+    heads[i] = &t->buckets[bucket_index(map, t, key_hash(map, keys[i]))];
+    __builtin_prefetch(heads[i]);
+  }
+  for (int i = 0; i < n; i++)
+    __builtin_prefetch(__atomic_load_n(heads[i], __ATOMIC_RELAXED));
+  reclaim_end(map);
+}
+
+/**
+ * Looks up n keys, with the effect of calling get() on each in turn.
+ * Keys go through in groups of TS_BATCH_GROUP; the next group's buckets
+ * are prefetched before the current group is resolved, so the cache
+ * misses of different keys overlap instead of following one another.
+ * @param keys the keys to look up
+ * @param values where to store each key's value, or INT_MAX if not found
+ * @param n the number of keys
+ */
+void get_batch(ts_hashmap_t *map, const int *keys, int *values, int n)
+{
+  prefetch_keys(map, keys, n < TS_BATCH_GROUP ? n : TS_BATCH_GROUP);
+  for (int i = 0; i < n; i += TS_BATCH_GROUP)
+  {
+    int next = i + TS_BATCH_GROUP;
+    if (next < n)
+      prefetch_keys(map, keys + next, n - next < TS_BATCH_GROUP ? n - next : TS_BATCH_GROUP);
+    for (int j = i; j < next && j < n; j++)
+      values[j] = get(map, keys[j]);
+  }
+}
+
+/**
+ * Orders write_batch() positions by stripe, then by position
+ */
+static int stripe_compare(const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Runs n puts, or dels if values is NULL, on the chained table grouped by
+ * lock stripe: each stripe is locked once for all of its keys, which it
+ * applies in batch order, so the outcome is the same as one at a time.
+ * The keys go through TS_WRITE_CHUNK at a time, sorted on the stack by
+ * stripe; within a group, the buckets of the next TS_BATCH_GROUP keys are
+ * prefetched as get_batch() does.
+ */
+static void write_batch(ts_hashmap_t *map, const int *keys, const int *values, int *old, int n)
+{
+  unsigned long long hashes[TS_WRITE_CHUNK];
+  unsigned long long order[TS_WRITE_CHUNK]; // stripe << 32 | position in the chunk
+  int ahead[TS_BATCH_GROUP];
+
+  for (int base = 0; base < n; base += TS_WRITE_CHUNK)
+  {
+    int count = (n - base < TS_WRITE_CHUNK) ? n - base : TS_WRITE_CHUNK;
+    for (int k = 0; k < count; k++)
+    {
+      hashes[k] = key_hash(map, keys[base + k]);
+      order[k] = (unsigned long long)hash_index(map, hashes[k], map->numLocks) << 32 | k;
+    }
+    qsort(order, count, sizeof(order[0]), stripe_compare);
+
+    for (int from = 0, to; from < count; from = to)
+    {
+      unsigned int s = order[from] >> 32;
+      for (to = from + 1; to < count && (order[to] >> 32) == s; to++)
+        ;
+
+      ts_stripe_t *stripe = &map->locks[s];
+      reclaim_begin(map);
+      ts_lock(&stripe->lock, map->lockKind);
+      write_begin(stripe);
+      for (int j = from; j < to; j++)
+      {
+        if ((j - from) % TS_BATCH_GROUP == 0 && j + TS_BATCH_GROUP < to)
+        {
+          int aheadCount = 0;
+          for (int k = j + TS_BATCH_GROUP; k < to && aheadCount < TS_BATCH_GROUP; k++)
+            ahead[aheadCount++] = keys[base + (unsigned int)order[k]];
+          prefetch_keys(map, ahead, aheadCount);
+        }
+
+        int k = (unsigned int)order[j];
+        ts_entry_t **bucket = find_bucket(map, hashes[k]);
+        int previous = (values != NULL) ? put_bucket(map, bucket, keys[base + k], values[base + k])
+                                        : del_bucket(map, bucket, keys[base + k]);
+        if (old != NULL)
+          old[base + k] = previous;
+      }
+      write_end(stripe);
+      ts_unlock(&stripe->lock, map->lockKind);
+      for (int j = from; j < to; j++)
+        after_op(map, 1);
+      reclaim_end(map);
+    }
+  }
+}
+
+/**
+ * Stores n key/value pairs, with the effect of calling put() on each in
+ * turn. The chained table takes each stripe's lock once for all of the
+ * batch's keys under it; other backends prefetch as get_batch() does.
+ * @param old where to store each key's previous value, or INT_MAX if it
+ *        was new; may be NULL
+ */
+void put_batch(ts_hashmap_t *map, const int *keys, const int *values, int *old, int n)
+{
+  if (map->ops == NULL)
+  {
+    write_batch(map, keys, values, old, n);
+    return;
+  }
+
+  prefetch_keys(map, keys, n < TS_BATCH_GROUP ? n : TS_BATCH_GROUP);
+  for (int i = 0; i < n; i += TS_BATCH_GROUP)
+  {
+    int next = i + TS_BATCH_GROUP;
+    if (next < n)
+      prefetch_keys(map, keys + next, n - next < TS_BATCH_GROUP ? n - next : TS_BATCH_GROUP);
+    for (int j = i; j < next && j < n; j++)
+    {
+      int previous = put(map, keys[j], values[j]);
+      if (old != NULL)
+        old[j] = previous;
+    }
+  }
+}
+
+/**
+ * Removes n keys, with the effect of calling del() on each in turn,
+ * grouped by stripe or prefetching as put_batch() does.
+ * @param old where to store each key's value, or INT_MAX if it was not
+ *        there; may be NULL
+ */
+void del_batch(ts_hashmap_t *map, const int *keys, int *old, int n)
+{
+  if (map->ops == NULL)
+  {
+    write_batch(map, keys, NULL, old, n);
+    return;
+  }
+
+  prefetch_keys(map, keys, n < TS_BATCH_GROUP ? n : TS_BATCH_GROUP);
+  for (int i = 0; i < n; i += TS_BATCH_GROUP)
+  {
+    int next = i + TS_BATCH_GROUP;
+    if (next < n)
+      prefetch_keys(map, keys + next, n - next < TS_BATCH_GROUP ? n - next : TS_BATCH_GROUP);
+    for (int j = i; j < next && j < n; j++)
+    {
+      int previous = del(map, keys[j]);
+      if (old != NULL)
+        old[j] = previous;
+    }
+  }
+}
+
+/**
+ * Prints a tree node's pair; a ts_tree_walk() visitor
+ */
+static void print_node(ts_tree_node_t *node, int depth, void *arg)
+{
+  printf(" (%d,%d)", node->key, node->value);
+}
+
+/**
+ * Prints the buckets of one table generation that have not moved on
+ */
+static void print_table(ts_table_t *t)
 {
-  for (int i = 0; i < map->capacity; i++)
+  for (int i = 0; i < t->capacity; i++)
   {
+    if (t->buckets[i] == TS_MOVED)
+      continue;
     printf("[%d] -> ", i);
-    ts_entry_t *entry = map->table[i];
+    ts_entry_t *entry = t->buckets[i];
+    if (is_tree(entry))
+    {
+      printf("tree:");
+      ts_tree_walk(as_tree(entry), print_node, NULL);
+      printf("\n");
+      continue;
+    }
     while (entry != NULL)
     {
       printf("(%d,%d)", entry->key, entry->value);
@@ -180,26 +1446,219 @@ void printmap(ts_hashmap_t *map)
   }
 }
 
+/**
+ * Prints the contents of the map (given)
+ */
+void printmap(ts_hashmap_t *map)
+{
+  if (map->ops != NULL)
+  {
+    map->ops->print(map);
+    return;
+  }
+
+  ts_table_t *t = map->table;
+  if (t->next != NULL)
+  {
+    printf("(not yet migrated)\n");
+    print_table(t);
+    printf("(resized)\n");
+    t = t->next;
+  }
+  print_table(t);
+}
+
+/**
+ * Frees table t and the trees in its buckets
+ */
+static void free_table(ts_table_t *t)
+{
+  for (int i = 0; i < t->capacity; i++)
+  {
+    if (is_tree(t->buckets[i]))
+      free(as_tree(t->buckets[i]));
+  }
+  free(t);
+}
+
 /**
  * Free up the space allocated for hashmap
  * @param map a pointer to the map
  */
 void freeMap(ts_hashmap_t *map)
 {
-  // Free each linked list in the table
-  for (int i = 0; i < map->capacity; i++)
+  if (map->ops != NULL)
   {
-    ts_entry_t *entry = map->table[i];
-    pthread_mutex_destroy(&map->locks[i]);
-    while (entry != NULL)
-    {
-      ts_entry_t *next = entry->next;
-      free(entry);
-      entry = next;
-    }
+    map->ops->free(map);
+    free(map->counters);
+    free(map);
+    return;
   }
 
-  free(map->table);
+  // The entries and tree nodes go with their slabs, without walking the
+  // chains
+  if (map->table->next != NULL)
+    free_table(map->table->next);
+  free_table(map->table);
+  ts_slab_pool_destroy(&map->entries);
+  ts_slab_pool_destroy(&map->treeNodes);
+
+  for (int i = 0; i < map->numLocks; i++)
+    ts_lock_destroy(&map->locks[i].lock, map->lockKind);
   free(map->locks);
+  free(map->counters);
   free(map);
-}
\ No newline at end of file
+}
+
+// Probe totals over the nodes of a tree, whose probe is their depth
+typedef struct tree_probes_t {
+  long total;
+  int max;
+} tree_probes_t;
+
+/**
+ * Adds a tree node's depth to the tree_probes_t totals; a ts_tree_walk()
+ * visitor
+ */
+static void probe_node(ts_tree_node_t *node, int depth, void *arg)
+{
+  tree_probes_t *probes = arg;
+  probes->total += depth;
+  if (depth > probes->max)
+    probes->max = depth;
+}
+
+/**
+ * Adds the chains and trees of one table generation's unmoved buckets to
+ * the probe totals, locking one bucket at a time
+ */
+static void table_stats(ts_hashmap_t *map, ts_table_t *t, ts_stats_t *stats, long *totalProbe, int *entries)
+{
+  for (int i = 0; i < t->capacity; i++)
+  {
+    ts_stripe_t *s = bucket_stripe(map, t, i);
+    ts_lock(&s->lock, map->lockKind);
+    if (is_tree(t->buckets[i]))
+    {
+      tree_probes_t probes = { 0, 0 };
+      ts_tree_walk(as_tree(t->buckets[i]), probe_node, &probes);
+      *totalProbe += probes.total;
+      *entries += as_tree(t->buckets[i])->count;
+      if (probes.max > stats->maxProbe)
+        stats->maxProbe = probes.max;
+      stats->trees++;
+      ts_unlock(&s->lock, map->lockKind);
+      continue;
+    }
+    int probe = 0;
+    for (ts_entry_t *entry = t->buckets[i]; entry != NULL && entry != TS_MOVED; entry = entry->next)
+    {
+      probe++;
+      *totalProbe += probe;
+      (*entries)++;
+    }
+    if (probe > stats->maxProbe)
+      stats->maxProbe = probe;
+    ts_unlock(&s->lock, map->lockKind);
+  }
+}
+
+/**
+ * Takes a snapshot of the map's size, operation counts and probe lengths.
+ * Buckets are locked and counter shards read one at a time, so under
+ * concurrent writers the numbers are approximate.
+ * @param map a pointer to the map
+ * @param stats where to store the snapshot
+ */
+void ts_stats_snapshot(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  memset(stats, 0, sizeof(ts_stats_t));
+  stats->capacity = map->capacity;
+
+  if (map->ops != NULL)
+  {
+    map->ops->stats(map, stats);
+  }
+  else
+  {
+    long totalProbe = 0;
+    int entries = 0;
+    ts_table_t *t;
+    ts_table_t *next;
+    reclaim_begin(map);
+    do
+    {
+      int slot = HP_TABLE;
+      t = current_table(map, slot);
+      next = (__atomic_load_n(&t->next, __ATOMIC_ACQUIRE) != NULL) ? next_table(map, t, &slot) : NULL;
+    } while (next == NULL && __atomic_load_n(&t->next, __ATOMIC_ACQUIRE) != NULL);
+
+    table_stats(map, t, stats, &totalProbe, &entries);
+    if (next != NULL)
+    {
+      table_stats(map, next, stats, &totalProbe, &entries);
+      stats->resizing = 1;
+      stats->oldCapacity = t->capacity;
+      stats->migrated = __atomic_load_n(&t->migrated, __ATOMIC_RELAXED);
+      stats->capacity = next->capacity;
+    }
+    reclaim_end(map);
+    if (entries > 0)
+      stats->meanProbe = (double)totalProbe / entries;
+
+    if (map->reclaim == TS_RECLAIM_HAZARD)
+    {
+      stats->retired = ts_hp_pending();
+      stats->retiredBound = ts_hp_bound();
+    }
+    else
+    {
+      stats->retired = ts_ebr_pending();
+      stats->retiredBound = -1;
+    }
+  }
+
+  for (int i = 0; i < map->numCounters; i++)
+  {
+    ts_counters_t *c = &map->counters[i];
+    stats->hits += __atomic_load_n(&c->hits, __ATOMIC_RELAXED);
+    stats->misses += __atomic_load_n(&c->misses, __ATOMIC_RELAXED);
+    stats->inserts += __atomic_load_n(&c->inserts, __ATOMIC_RELAXED);
+    stats->updates += __atomic_load_n(&c->updates, __ATOMIC_RELAXED);
+    stats->deletes += __atomic_load_n(&c->deletes, __ATOMIC_RELAXED);
+    stats->numOps += __atomic_load_n(&c->delMisses, __ATOMIC_RELAXED);
+    stats->chainSteps += __atomic_load_n(&c->chainSteps, __ATOMIC_RELAXED);
+    stats->reseeds += __atomic_load_n(&c->reseeds, __ATOMIC_RELAXED);
+  }
+  stats->size = stats->inserts - stats->deletes;
+  stats->numOps += stats->hits + stats->misses + stats->inserts + stats->updates + stats->deletes;
+}
+
+/**
+ * Returns the short name of a backend, as accepted by ts_backend_parse()
+ */
+const char *ts_backend_name(ts_backend_t backend)
+{
+  if (backend < 0 || backend >= TS_NUM_BACKENDS)
+    return "unknown";
+  return backendNames[backend];
+}
+
+/**
+ * Looks up a backend by its short name
+ * @param name a name such as "chained" or "oa"
+ * @param backend where to store the matching backend
+ * @return 0 on success, or -1 if no backend has that name
+ */
+int ts_backend_parse(const char *name, ts_backend_t *backend)
+{
+  for (int i = 0; i < TS_NUM_BACKENDS; i++)
+  {
+    if (strcmp(name, backendNames[i]) == 0)
+    {
+      *backend = i;
+      return 0;
+    }
+  }
+  return -1;
+}
@@ -1,4 +1,11 @@
+#ifndef TS_HASHMAP_H_
+#define TS_HASHMAP_H_
+
+#include <limits.h>
 #include <pthread.h>
+#include "ts_hash.h"
+#include "ts_lock.h"
+#include "ts_slab.h"
 
 // A hashmap entry stores the key, value
 // and a pointer to the next entry
@@ -8,22 +15,166 @@ typedef struct ts_entry_t {
    struct ts_entry_t *next;
 } ts_entry_t;
 
+// Storage layouts that can sit behind the hashmap API.
+// TS_CHAINED is the original table of per-bucket linked lists.
+typedef enum ts_backend_t {
+   TS_CHAINED = 0,
+   TS_OPEN_ADDRESSING,   // linear probing over flat key/value arrays
+   TS_ROBIN_HOOD,        // linear probing, displacement-ordered runs
+   TS_SWISS,             // SIMD-matched control bytes beside the slots
+   TS_CUCKOO,            // 4-way buckets, two hash functions, striped locks
+   TS_HOPSCOTCH,         // neighborhood bitmaps, optimistic lock-free reads
+   TS_SPLIT_ORDER,       // lock-free list in split order, grows without rehashing
+   TS_EXTENDIBLE,        // directory of bucket pages, full pages split alone
+   TS_LOCK_FREE,         // chained buckets as lock-free sorted lists, fixed size
+   TS_COMPACT,           // chained with 12-byte entries linked by 32-bit indices
+   TS_INLINE,            // chained with each bucket's first entry in the bucket
+   TS_NUM_BACKENDS
+} ts_backend_t;
+
+// How the chained table frees entries and tables that a lock-free get()
+// may still be reading.
+typedef enum ts_reclaim_t {
+   TS_RECLAIM_EBR = 0,   // epochs: cheapest reads, but a stalled thread holds up every free
+   TS_RECLAIM_HAZARD,    // hazard pointers: a fence per entry read, bounded garbage
+   TS_NUM_RECLAIMS
+} ts_reclaim_t;
+
+// Options for initmap_config(). Fields left zeroed take their defaults,
+// so { .capacity = n } is the same map as initmap(n).
+// The chained table grows once size exceeds maxLoad * capacity and
+// shrinks, never below its initial capacity, once size falls under
+// minLoad * capacity. A negative value turns that direction off.
+// Its buckets share stripes locks, capped at the capacity; the capacity
+// is rounded up to a multiple of the stripe count.
+// get() reads a bucket without its lock up to readTries times while
+// writers keep changing it, then takes the lock; negative always locks.
+// hash picks the function that spreads keys over buckets (ts_hash.h).
+// With a mixing function, each stripe guards a contiguous range of
+// buckets rather than every numLocks-th one. TS_HASH_SIPHASH is keyed
+// with a secret drawn per map, for key streams an adversary may pick.
+// A bucket whose chain grows past treeify entries holds them in a
+// red-black tree instead, and goes back to a chain at three quarters of
+// that; negative keeps every bucket a chain.
+typedef struct ts_config_t {
+   int capacity;
+   ts_backend_t backend;
+   double maxLoad;      // default 0.75
+   double minLoad;      // default 0.2
+   int stripes;         // default 4 per online core
+   ts_lock_kind_t lock; // how stripes are taken, default pthread mutex
+   int readTries;       // default 4
+   ts_reclaim_t reclaim; // default EBR
+   ts_hash_t hash;      // default identity
+   int treeify;         // default 8
+} ts_config_t;
+
+// A point-in-time view of a map, filled in by ts_stats_snapshot().
+// A probe is one bucket entry or slot examined while finding a stored key,
+// so a key found at its home position has probe length 1.
+// The operation counts are summed over the map's counter shards.
+typedef struct ts_stats_t {
+   int size;
+   int capacity;
+   long numOps;
+   long hits;           // get() found the key
+   long misses;         // get() did not
+   long inserts;
+   long updates;        // put() of a key already there
+   long deletes;
+   long chainSteps;     // entries get() walked, chained and lockfree only
+   long reseeds;        // rehashes a long chain set off, chained siphash only
+   int trees;           // buckets held as trees, chained only
+   int maxProbe;        // longest probe over all stored keys
+   double meanProbe;    // average probe over all stored keys
+   int resizing;        // 1 while entries move to a resized table
+   int oldCapacity;     // capacity being migrated from, while resizing
+   int migrated;        // buckets of the old table migrated so far
+   long retired;        // nodes retired but not yet freed, by all maps
+                        // sharing the map's reclamation scheme
+   long retiredBound;   // most that can be waiting, or -1 if unbounded
+} ts_stats_t;
+
+struct ts_ops_t;
+struct ts_table_t;
+
+// One shard of a map's operation counters. Each thread adds to its own
+// shard of every map, so no two cores keep writing the same cache line;
+// ts_stats_snapshot() sums them. Threads beyond the shard count share,
+// so the adds are still atomic.
+typedef struct ts_counters_t {
+   long hits;
+   long misses;
+   long inserts;
+   long updates;
+   long deletes;
+   long delMisses;      // del() of a key not there
+   long chainSteps;
+   long reseeds;
+} __attribute__((aligned(64))) ts_counters_t;
+
+// A chained lock stripe, padded so that no two stripes share a cache line.
+// Writers make version odd while they change a bucket of the stripe, so
+// get() can read without the lock and check the version afterwards.
+// Deleted entries are freed through EBR (ts_ebr.h) or hazard pointers
+// (ts_hazard.h), once no such reader can still be on them.
+typedef struct ts_stripe_t {
+   ts_lock_t lock;
+   unsigned int version;
+} __attribute__((aligned(64))) ts_stripe_t;
+
 // A hashmap contains an array of pointers to entries,
-// the capacity of the array, the size (number of entries stored), 
-// an array of mutex locks,
-// and the number of operations that it has run.
+// the capacity of the array, an array of lock stripes,
+// and counters of the operations that it has run, which also give its
+// size (number of entries stored).
+// The capacity doubles or halves as the load changes. Every capacity is
+// a multiple of the stripe count, so a key's stripe does not change when
+// it moves to a resized table.
+// While a resize is in progress, the next table hangs off the current one
+// and every operation moves a few buckets over before it returns.
+// Maps built with another backend leave table and locks unused and keep
+// their own state in impl, reached through ops.
 typedef struct ts_hashmap_t {
-   ts_entry_t **table;
-   int numOps;
+   struct ts_table_t *table;
    int capacity;
-   int size;
-   pthread_mutex_t *locks;
+   ts_counters_t *counters;
+   int numCounters;              // a power of two
+   ts_stripe_t *locks;
+   int numLocks;                 // see bucket_stripe() for which bucket each guards
+   int minCapacity;              // shrinking stops here
+   ts_lock_kind_t lockKind;
+   int readTries;
+   ts_reclaim_t reclaim;
+   ts_hash_t hash;
+   unsigned long long secret[2]; // SipHash key, fixed for the map's life
+   ts_slab_pool_t entries;       // where the chained table's entries come from
+   ts_slab_pool_t treeNodes;     // and the nodes of its trees
+   int treeify;                  // chain length past which a bucket becomes a tree
+   int trees;                    // buckets holding a tree, in any generation
+   double maxLoad;
+   double minLoad;
+   const struct ts_ops_t *ops;
+   void *impl;
 } ts_hashmap_t;
 
+// What put() returns when it could not store a new key, say for want of
+// memory, as against INT_MAX for a key it stored. Like INT_MAX from get(),
+// it cannot be told apart from an old value that happens to be INT_MIN.
+#define TS_PUT_FAILED INT_MIN
+
 // function declarations
 ts_hashmap_t *initmap(int);
+ts_hashmap_t *initmap_config(const ts_config_t*);
 int get(ts_hashmap_t*, int);
 int put(ts_hashmap_t*, int, int);
 int del(ts_hashmap_t*, int);
+void get_batch(ts_hashmap_t*, const int*, int*, int);
+void put_batch(ts_hashmap_t*, const int*, const int*, int*, int);
+void del_batch(ts_hashmap_t*, const int*, int*, int);
 void printmap(ts_hashmap_t*);
-void freeMap(ts_hashmap_t*);
\ No newline at end of file
+void freeMap(ts_hashmap_t*);
+void ts_stats_snapshot(ts_hashmap_t*, ts_stats_t*);
+const char *ts_backend_name(ts_backend_t);
+int ts_backend_parse(const char*, ts_backend_t*);
+
+#endif /* TS_HASHMAP_H_ */
@@ -0,0 +1,208 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ts_hazard.h"
+
+typedef struct hp_item_t {
+  void *p;
+  void (*destroy)(void *);
+} hp_item_t;
+
+// One per thread, on a list that only grows. slots are read by every
+// thread that scans, so each record has its own cache line.
+typedef struct hp_thread_t {
+  void *slots[TS_HP_SLOTS];
+  int inUse;
+  int count;                 // retired nodes not yet freed
+  int size;
+  hp_item_t *retired;
+  void **hazards;            // scratch space for a scan
+  int hazardSize;
+  struct hp_thread_t *next;
+} __attribute__((aligned(64))) hp_thread_t;
+
+static hp_thread_t *threads = NULL;
+static int numThreads = 0;
+static pthread_key_t exitKey;
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static __thread hp_thread_t *self = NULL;
+
+/**
+ * Runs when a registered thread exits. Its retired nodes stay in the
+ * record for whichever thread takes it over.
+ */
+static void hp_thread_exit(void *arg)
+{
+  hp_thread_t *r = arg;
+  for (int i = 0; i < TS_HP_SLOTS; i++)
+    __atomic_store_n(&r->slots[i], NULL, __ATOMIC_RELEASE);
+  __atomic_store_n(&r->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void hp_make_key(void)
+{
+  pthread_key_create(&exitKey, hp_thread_exit);
+}
+
+/**
+ * Returns the calling thread's record, claiming an abandoned one or
+ * adding a new one the first time
+ */
+static hp_thread_t *hp_self(void)
+{
+  if (self != NULL)
+    return self;
+
+  pthread_once(&keyOnce, hp_make_key);
+  for (hp_thread_t *r = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); r != NULL && self == NULL; r = r->next)
+  {
+    int unused = 0;
+    if (__atomic_load_n(&r->inUse, __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&r->inUse, &unused, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      self = r;
+  }
+
+  if (self == NULL)
+  {
+    hp_thread_t *r = aligned_alloc(64, sizeof(hp_thread_t));
+    memset(r, 0, sizeof(hp_thread_t));
+    r->inUse = 1;
+    r->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    __atomic_fetch_add(&numThreads, 1, __ATOMIC_RELAXED);
+    self = r;
+  }
+  pthread_setspecific(exitKey, self);
+  return self;
+}
+
+/**
+ * Loads *src and protects what it points to in the given slot
+ * @return the protected pointer, which *src held after it was published
+ */
+void *ts_hp_protect(int slot, void **src)
+{
+  hp_thread_t *r = hp_self();
+  void *p = __atomic_load_n(src, __ATOMIC_ACQUIRE);
+  while (1)
+  {
+    // Release: the reads of whatever the slot protected before come first
+    __atomic_store_n(&r->slots[slot], p, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pairs with the one in hp_scan()
+    void *again = __atomic_load_n(src, __ATOMIC_ACQUIRE);
+    if (again == p)
+      return p;
+    p = again;
+  }
+}
+
+/**
+ * Publishes p in the given slot. p is only protected if the caller then
+ * finds it still reachable.
+ */
+void ts_hp_set(int slot, void *p)
+{
+  hp_thread_t *r = hp_self();
+  __atomic_store_n(&r->slots[slot], p, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * Drops every pointer the calling thread protects
+ */
+void ts_hp_clear(void)
+{
+  hp_thread_t *r = hp_self();
+  for (int i = 0; i < TS_HP_SLOTS; i++)
+    __atomic_store_n(&r->slots[i], NULL, __ATOMIC_RELEASE);
+}
+
+static int hp_compare(const void *a, const void *b)
+{
+  const char *x = *(void *const *)a;
+  const char *y = *(void *const *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Frees every node r retired that no thread's slot names
+ */
+static void hp_scan(hp_thread_t *r)
+{
+  int found = 0;
+
+  // The unlinks must be visible before the slots are read
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (hp_thread_t *t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next)
+  {
+    for (int i = 0; i < TS_HP_SLOTS; i++)
+    {
+      void *p = __atomic_load_n(&t->slots[i], __ATOMIC_ACQUIRE);
+      if (p == NULL)
+        continue;
+      if (found == r->hazardSize)
+      {
+        r->hazardSize = r->hazardSize ? r->hazardSize * 2 : TS_HP_SLOTS * 16;
+        r->hazards = realloc(r->hazards, sizeof(void *) * r->hazardSize);
+      }
+      r->hazards[found++] = p;
+    }
+  }
+  qsort(r->hazards, found, sizeof(void *), hp_compare);
+
+  int kept = 0;
+  for (int i = 0; i < r->count; i++)
+  {
+    if (bsearch(&r->retired[i].p, r->hazards, found, sizeof(void *), hp_compare) != NULL)
+      r->retired[kept++] = r->retired[i];
+    else
+      r->retired[i].destroy(r->retired[i].p);
+  }
+  __atomic_store_n(&r->count, kept, __ATOMIC_RELAXED);
+}
+
+/**
+ * Frees p with destroy (free() if NULL) once no slot names it. Call after
+ * p has been unlinked from every shared structure.
+ */
+void ts_hp_retire(void *p, void (*destroy)(void *))
+{
+  hp_thread_t *r = hp_self();
+
+  if (r->count == r->size)
+  {
+    r->size = r->size ? r->size * 2 : TS_HP_BATCH;
+    r->retired = realloc(r->retired, sizeof(hp_item_t) * r->size);
+  }
+  r->retired[r->count].p = p;
+  r->retired[r->count].destroy = destroy ? destroy : free;
+  __atomic_store_n(&r->count, r->count + 1, __ATOMIC_RELAXED);
+
+  // At most TS_HP_SLOTS * numThreads nodes survive a scan, so each scan
+  // frees at least TS_HP_BATCH
+  if (r->count >= TS_HP_SLOTS * __atomic_load_n(&numThreads, __ATOMIC_RELAXED) + TS_HP_BATCH)
+    hp_scan(r);
+}
+
+/**
+ * Counts the nodes retired by every thread and not yet freed. Other
+ * threads keep retiring meanwhile, so the count is approximate.
+ */
+long ts_hp_pending(void)
+{
+  long pending = 0;
+  for (hp_thread_t *r = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); r != NULL; r = r->next)
+    pending += __atomic_load_n(&r->count, __ATOMIC_RELAXED);
+  return pending;
+}
+
+/**
+ * The most nodes that can be waiting to be freed with the threads
+ * registered so far
+ */
+long ts_hp_bound(void)
+{
+  long n = __atomic_load_n(&numThreads, __ATOMIC_RELAXED);
+  return n * (TS_HP_SLOTS * n + TS_HP_BATCH);
+}
@@ -0,0 +1,30 @@
+#ifndef TS_HAZARD_H_
+#define TS_HAZARD_H_
+
+// Hazard pointers. Before a thread dereferences a shared node without a
+// lock, it publishes the node's address in one of its TS_HP_SLOTS slots
+// and then checks that the node is still reachable; ts_hp_protect() does
+// both for a node read from a single link. Unlinked nodes are handed to
+// ts_hp_retire(), and once a thread has retired enough of them it frees
+// every one that no slot names.
+//
+// Unlike EBR, a thread that stalls in the middle of a read only holds on
+// to the nodes its own slots name. With T registered threads, at most
+// T * (TS_HP_SLOTS * T + TS_HP_BATCH) nodes are ever waiting to be freed.
+// The price is a full fence for every node protected.
+//
+// Threads register on first use; a thread that exits clears its slots
+// and leaves its record, with anything still retired, to the next new
+// thread.
+
+#define TS_HP_SLOTS 3        // hazard pointers per thread
+#define TS_HP_BATCH 64       // retirements beyond the hazard count before a scan
+
+void *ts_hp_protect(int, void**);
+void ts_hp_set(int, void*);
+void ts_hp_clear(void);
+void ts_hp_retire(void*, void (*)(void*));
+long ts_hp_pending(void);
+long ts_hp_bound(void);
+
+#endif /* TS_HAZARD_H_ */
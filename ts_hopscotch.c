@@ -0,0 +1,488 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ts_backend.h"
+#include "ts_ebr.h"
+
+#define HS_HOP 32            // neighborhood size: a key lives < HS_HOP slots from home
+#define HS_ADD_RANGE 4096    // how far put looks for a free slot before growing
+#define HS_SEGMENTS 256      // lock/version segments
+#define HS_READ_TRIES 8      // optimistic attempts before get() takes the lock
+
+// hopInfo bit i of bucket h is set when bucket h + i holds a key whose
+// home is h, so a lookup only visits the buckets named in its home's
+// bitmap. The table has HS_ADD_RANGE extra buckets past the last home so
+// that neither neighborhoods nor the free-slot search ever wrap. With a
+// 32-bit bitmap a bucket is 16 bytes and a neighborhood 512, eight cache
+// lines, but a lookup reads only the buckets its bitmap names, and most
+// keys sit at or next to home, in the line with its bitmap. Halving
+// HS_HOP would halve the span, but random keys then fill only 65-85% of
+// the table before it has to grow, against 83-93%. Writers set full
+// under the segment locks around the bucket, but a put's free-slot search
+// reads it in neighboring segments too, so it is only touched through
+// atomics.
+typedef struct hs_bucket_t {
+  int key;
+  int value;
+  unsigned int hopInfo;
+  int full;
+} hs_bucket_t;
+
+// One generation of the bucket array. Growing publishes a new one and
+// retires the old one through EBR: get() may still be reading it without
+// a lock, and put() and del() read its geometry before they lock.
+typedef struct hs_array_t {
+  hs_bucket_t *buckets;
+  unsigned int mask;         // homes - 1
+  int shift;                 // 32 - log2(homes), for the multiplicative hash
+  unsigned int total;        // homes + HS_ADD_RANGE
+  int segShift;              // bucket b is in segment b >> segShift
+} hs_array_t;
+
+// A segment's lock serializes writers whose homes or free-slot search
+// reach into it. Its version is odd while a writer deletes or displaces a
+// key whose home is in the segment; get() reads without locking and
+// retries if the version of its home's segment moved meanwhile.
+typedef struct hs_segment_t {
+  pthread_mutex_t lock;
+  unsigned int version;
+} __attribute__((aligned(64))) hs_segment_t;
+
+typedef struct hs_table_t {
+  hs_array_t *cur;
+  hs_segment_t segments[HS_SEGMENTS];
+} hs_table_t;
+
+static inline unsigned int hs_home(const hs_array_t *a, int key)
+{
+  return ((unsigned int)key * 2654435769u) >> a->shift;
+}
+
+static inline unsigned int hs_seg(const hs_array_t *a, unsigned int b)
+{
+  unsigned int s = b >> a->segShift;
+  return s < HS_SEGMENTS ? s : HS_SEGMENTS - 1;
+}
+
+/**
+ * Marks the start of a change that readers of segment s must not see
+ * half done
+ */
+static inline void hs_write_begin(hs_table_t *t, unsigned int s)
+{
+  __atomic_fetch_add(&t->segments[s].version, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void hs_write_end(hs_table_t *t, unsigned int s)
+{
+  __atomic_fetch_add(&t->segments[s].version, 1, __ATOMIC_RELEASE);
+}
+
+static hs_array_t *hs_alloc_array(unsigned int homes)
+{
+  hs_array_t *a = malloc(sizeof(hs_array_t));
+  if (a == NULL)
+    return NULL;
+  a->mask = homes - 1;
+  a->shift = 32 - __builtin_ctz(homes);
+  a->total = homes + HS_ADD_RANGE;
+  a->buckets = calloc(a->total, sizeof(hs_bucket_t));
+  if (a->buckets == NULL)
+  {
+    free(a);
+    return NULL;
+  }
+  a->segShift = 0;
+  while ((homes >> a->segShift) > HS_SEGMENTS)
+    a->segShift++;
+  return a;
+}
+
+static void hs_free_array(void *p)
+{
+  hs_array_t *a = p;
+  free(a->buckets);
+  free(a);
+}
+
+/**
+ * Looks for key in the neighborhood of its home
+ * @return the bucket holding key, or -1
+ */
+static long hs_find(const hs_array_t *a, unsigned int home, int key)
+{
+  unsigned int hop = __atomic_load_n(&a->buckets[home].hopInfo, __ATOMIC_ACQUIRE);
+  while (hop != 0)
+  {
+    unsigned int b = home + __builtin_ctz(hop);
+    if (__atomic_load_n(&a->buckets[b].key, __ATOMIC_RELAXED) == key)
+      return b;
+    hop &= hop - 1;
+  }
+  return -1;
+}
+
+/**
+ * Moves an earlier key into free bucket f, closer to its own home, so
+ * that the bucket it vacates is nearer the inserting key's home.
+ * @return the vacated bucket, or -1 if no key can move
+ */
+static long hs_closer(hs_table_t *t, hs_array_t *a, unsigned int f)
+{
+  for (unsigned int h = f - (HS_HOP - 1); h < f; h++)
+  {
+    unsigned int hop = a->buckets[h].hopInfo & ((1u << (f - h)) - 1);
+    if (hop == 0)
+      continue;
+
+    unsigned int m = h + __builtin_ctz(hop);
+    hs_bucket_t *from = &a->buckets[m];
+    hs_bucket_t *to = &a->buckets[f];
+    unsigned int s = (t != NULL) ? hs_seg(a, h) : 0;
+
+    if (t != NULL)
+      hs_write_begin(t, s);
+    __atomic_store_n(&to->key, from->key, __ATOMIC_RELAXED);
+    __atomic_store_n(&to->value, from->value, __ATOMIC_RELAXED);
+    __atomic_store_n(&to->full, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&a->buckets[h].hopInfo, (a->buckets[h].hopInfo | (1u << (f - h))) & ~(1u << (m - h)), __ATOMIC_RELEASE);
+    __atomic_store_n(&from->full, 0, __ATOMIC_RELAXED);
+    if (t != NULL)
+      hs_write_end(t, s);
+    return m;
+  }
+  return -1;
+}
+
+/**
+ * Inserts a key that is not in the array, looking for a free bucket up to
+ * range buckets from home. Caller holds the segments from home - HS_HOP + 1
+ * to home + range - 1, or t is NULL while a new array is still private.
+ * @return 0, or -1 if no free bucket can be brought into the neighborhood
+ */
+static int hs_place(hs_table_t *t, hs_array_t *a, int key, int value, unsigned int range)
+{
+  unsigned int home = hs_home(a, key);
+  unsigned int end = home + range < a->total ? home + range : a->total;
+  long f = home;
+
+  while (f < end && __atomic_load_n(&a->buckets[f].full, __ATOMIC_RELAXED))
+    f++;
+  if (f == end)
+    return -1;
+
+  while (f - home >= HS_HOP)
+  {
+    if ((f = hs_closer(t, a, f)) < 0)
+      return -1;
+  }
+
+  __atomic_store_n(&a->buckets[f].key, key, __ATOMIC_RELAXED);
+  __atomic_store_n(&a->buckets[f].value, value, __ATOMIC_RELAXED);
+  __atomic_store_n(&a->buckets[f].full, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&a->buckets[home].hopInfo, a->buckets[home].hopInfo | (1u << (f - home)), __ATOMIC_RELEASE);
+  return 0;
+}
+
+/**
+ * Locks the segments a put of a key with this home may touch when it
+ * searches range buckets for a free one
+ */
+static void hs_lock_range(hs_table_t *t, const hs_array_t *a, unsigned int home, unsigned int range,
+                          unsigned int *lo, unsigned int *hi)
+{
+  unsigned int first = home >= HS_HOP - 1 ? home - (HS_HOP - 1) : 0;
+  unsigned int last = home + range - 1 < a->total ? home + range - 1 : a->total - 1;
+  *lo = hs_seg(a, first);
+  *hi = hs_seg(a, last);
+  for (unsigned int s = *lo; s <= *hi; s++)
+    pthread_mutex_lock(&t->segments[s].lock);
+}
+
+static void hs_unlock_range(hs_table_t *t, unsigned int lo, unsigned int hi)
+{
+  for (unsigned int s = hi + 1; s-- > lo; )
+    pthread_mutex_unlock(&t->segments[s].lock);
+}
+
+/**
+ * Rebuilds into an array with twice as many homes (more if a
+ * neighborhood still overflows), unless another thread already replaced
+ * seen. Holds every segment lock.
+ * @return 0 if seen has been replaced, or -1 if it could not be, for
+ *         want of memory or past 2^30 homes
+ */
+static int hs_grow(ts_hashmap_t *map, hs_array_t *seen)
+{
+  hs_table_t *t = map->impl;
+  int result = 0;
+
+  for (int s = 0; s < HS_SEGMENTS; s++)
+    pthread_mutex_lock(&t->segments[s].lock);
+
+  if (t->cur == seen)
+  {
+    unsigned int homes = (seen->mask + 1) * 2;
+    hs_array_t *a = NULL;
+    while (a == NULL && homes < (1u << 30))
+    {
+      if ((a = hs_alloc_array(homes)) == NULL)
+        break;
+      int placed = 1;
+      for (unsigned int b = 0; placed && b < seen->total; b++)
+      {
+        if (__atomic_load_n(&seen->buckets[b].full, __ATOMIC_RELAXED))
+          placed = (hs_place(NULL, a, seen->buckets[b].key, seen->buckets[b].value, HS_ADD_RANGE) == 0);
+      }
+      if (!placed)
+      {
+        hs_free_array(a);
+        a = NULL;
+        homes *= 2;
+      }
+    }
+
+    if (a != NULL)
+    {
+      __atomic_store_n(&t->cur, a, __ATOMIC_RELEASE);
+      map->capacity = a->mask + 1;
+      ts_ebr_retire(seen, hs_free_array);
+    }
+    else
+    {
+      result = -1;
+    }
+  }
+
+  for (int s = HS_SEGMENTS - 1; s >= 0; s--)
+    pthread_mutex_unlock(&t->segments[s].lock);
+  return result;
+}
+
+static int hs_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  hs_table_t *t = aligned_alloc(64, sizeof(hs_table_t));
+  unsigned int homes = HS_HOP;
+  while (homes < (1u << 30) && homes < (unsigned int)config->capacity)
+    homes *= 2;
+
+  if (t == NULL || (t->cur = hs_alloc_array(homes)) == NULL)
+  {
+    free(t);
+    return -1;
+  }
+  for (int s = 0; s < HS_SEGMENTS; s++)
+  {
+    pthread_mutex_init(&t->segments[s].lock, NULL);
+    t->segments[s].version = 0;
+  }
+
+  map->impl = t;
+  map->capacity = homes;
+  return 0;
+}
+
+static int hs_get(ts_hashmap_t *map, int key)
+{
+  hs_table_t *t = map->impl;
+  int returnVal = INT_MAX;
+
+  // Optimistic: read without the lock, then check that no writer
+  // deleted or moved a key of this home segment while we looked
+  ts_ebr_enter();
+  for (int attempt = 0; attempt < HS_READ_TRIES; attempt++)
+  {
+    hs_array_t *a = __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE);
+    unsigned int home = hs_home(a, key);
+    unsigned int *version = &t->segments[hs_seg(a, home)].version;
+    unsigned int before = __atomic_load_n(version, __ATOMIC_ACQUIRE);
+    if (before & 1)
+      continue;
+
+    long b = hs_find(a, home, key);
+    int value = (b >= 0) ? __atomic_load_n(&a->buckets[b].value, __ATOMIC_RELAXED) : INT_MAX;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(version, __ATOMIC_RELAXED) == before)
+    {
+      ts_ebr_exit();
+      ts_count_get(map, value);
+      return value;
+    }
+  }
+
+  // Too much churn on this segment: wait for the writers instead
+  while (1)
+  {
+    hs_array_t *a = __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE);
+    unsigned int home = hs_home(a, key);
+    pthread_mutex_t *lock = &t->segments[hs_seg(a, home)].lock;
+    pthread_mutex_lock(lock);
+    if (a == t->cur)
+    {
+      long b = hs_find(a, home, key);
+      if (b >= 0)
+        returnVal = a->buckets[b].value;
+      pthread_mutex_unlock(lock);
+      ts_ebr_exit();
+      ts_count_get(map, returnVal);
+      return returnVal;
+    }
+    pthread_mutex_unlock(lock);
+  }
+}
+
+static int hs_put(ts_hashmap_t *map, int key, int value)
+{
+  hs_table_t *t = map->impl;
+  unsigned int range = HS_HOP;
+
+  // Most puts find a free bucket inside the neighborhood and lock only
+  // the segments around it. The rest retry with the full search range.
+  // The array may be retired by a grow until the locks are held.
+  ts_ebr_enter();
+  while (1)
+  {
+    hs_array_t *a = __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE);
+    unsigned int home = hs_home(a, key);
+    unsigned int lo, hi;
+
+    hs_lock_range(t, a, home, range, &lo, &hi);
+    if (a != t->cur) // Grown while we waited
+    {
+      hs_unlock_range(t, lo, hi);
+      continue;
+    }
+
+    long b = hs_find(a, home, key);
+    if (b >= 0) // Key exists, replace the value
+    {
+      int temp = a->buckets[b].value;
+      __atomic_store_n(&a->buckets[b].value, value, __ATOMIC_RELAXED);
+      hs_unlock_range(t, lo, hi);
+      ts_ebr_exit();
+      TS_COUNT(map, updates);
+      return temp;
+    }
+
+    if (hs_place(t, a, key, value, range) == 0)
+    {
+      hs_unlock_range(t, lo, hi);
+      ts_ebr_exit();
+      TS_COUNT(map, inserts);
+      return INT_MAX;
+    }
+
+    hs_unlock_range(t, lo, hi);
+    if (range < HS_ADD_RANGE)
+    {
+      range = HS_ADD_RANGE;
+    }
+    else if (hs_grow(map, a) < 0)
+    {
+      ts_ebr_exit();
+      return TS_PUT_FAILED;
+    }
+  }
+}
+
+static int hs_del(ts_hashmap_t *map, int key)
+{
+  hs_table_t *t = map->impl;
+  int returnVal = INT_MAX;
+
+  ts_ebr_enter();
+  while (1)
+  {
+    hs_array_t *a = __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE);
+    unsigned int home = hs_home(a, key);
+    unsigned int s = hs_seg(a, home);
+
+    pthread_mutex_lock(&t->segments[s].lock);
+    if (a != t->cur)
+    {
+      pthread_mutex_unlock(&t->segments[s].lock);
+      continue;
+    }
+
+    long b = hs_find(a, home, key);
+    if (b >= 0)
+    {
+      returnVal = a->buckets[b].value;
+      hs_write_begin(t, s);
+      __atomic_store_n(&a->buckets[home].hopInfo, a->buckets[home].hopInfo & ~(1u << (b - home)), __ATOMIC_RELEASE);
+      __atomic_store_n(&a->buckets[b].full, 0, __ATOMIC_RELAXED);
+      hs_write_end(t, s);
+    }
+    pthread_mutex_unlock(&t->segments[s].lock);
+    ts_ebr_exit();
+    if (b >= 0)
+      TS_COUNT(map, deletes);
+    else
+      TS_COUNT(map, delMisses);
+    return returnVal;
+  }
+}
+
+static void hs_print(ts_hashmap_t *map)
+{
+  hs_array_t *a = ((hs_table_t *)map->impl)->cur;
+  for (unsigned int b = 0; b < a->total; b++)
+  {
+    printf("[%u] -> ", b);
+    if (__atomic_load_n(&a->buckets[b].full, __ATOMIC_RELAXED))
+      printf("(%d,%d)", a->buckets[b].key, a->buckets[b].value);
+    printf("\n");
+  }
+}
+
+static void hs_free(ts_hashmap_t *map)
+{
+  hs_table_t *t = map->impl;
+  hs_free_array(t->cur);
+  for (int s = 0; s < HS_SEGMENTS; s++)
+    pthread_mutex_destroy(&t->segments[s].lock);
+  free(t);
+}
+
+/**
+ * Probe length is the key's offset from home plus one; it never
+ * exceeds HS_HOP.
+ */
+static void hs_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  hs_table_t *t = map->impl;
+  long totalProbe = 0;
+  int entries = 0;
+
+  for (int s = 0; s < HS_SEGMENTS; s++)
+    pthread_mutex_lock(&t->segments[s].lock);
+  hs_array_t *a = t->cur;
+  for (unsigned int b = 0; b < a->total; b++)
+  {
+    if (!__atomic_load_n(&a->buckets[b].full, __ATOMIC_RELAXED))
+      continue;
+    int probe = b - hs_home(a, a->buckets[b].key) + 1;
+    totalProbe += probe;
+    entries++;
+    if (probe > stats->maxProbe)
+      stats->maxProbe = probe;
+  }
+  for (int s = HS_SEGMENTS - 1; s >= 0; s--)
+    pthread_mutex_unlock(&t->segments[s].lock);
+
+  if (entries > 0)
+    stats->meanProbe = (double)totalProbe / entries;
+}
+
+const ts_ops_t ts_hopscotch_ops = {
+  .init = hs_init,
+  .get = hs_get,
+  .put = hs_put,
+  .del = hs_del,
+  .print = hs_print,
+  .free = hs_free,
+  .stats = hs_stats,
+};
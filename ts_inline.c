@@ -0,0 +1,619 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "ts_backend.h"
+#include "ts_ebr.h"
+
+#define IL_USED 1ul           // low bit of chain: the bucket holds an entry
+#define IL_PAIRS 7            // key/value pairs per overflow node
+#define IL_COUNT 7ul          // low bits of a node's link: its pairs in use
+#define IL_MAX_LOAD 0.75      // default entries per bucket before growing
+#define IL_READ_TRIES 4       // default optimistic attempts before get() locks
+#define IL_STRIPES_PER_CORE 4
+#define IL_MAX_CAPACITY (1u << 30)
+
+// Overflow for keys that did not fit in their bucket: seven pairs and the
+// link to the next node fill one cache line, so a long chain costs one
+// dependent load per seven entries, and a put allocates once per seven.
+// Slabs carve nodes on 64-byte boundaries, which leaves the low bits of a
+// node's address free to count its pairs in use. Those are always its
+// first pairs, and only the first node of a chain is ever partly full.
+typedef struct il_node_t {
+  int keys[IL_PAIRS];
+  int values[IL_PAIRS];
+  unsigned long link;         // next node, plus the pairs in use
+} __attribute__((aligned(64))) il_node_t;
+
+// The chained layout with each bucket's first entry stored in the bucket
+// itself, so a key alone in its bucket is found with one cache miss and
+// a miss on an empty bucket never leaves the array. chain holds the first
+// overflow node with IL_USED in its low bit, so a reader sees whether the
+// bucket is used and where its chain goes in one load. A bucket with
+// overflow nodes always has its inline entry in use.
+typedef struct il_bucket_t {
+  int key;
+  int value;
+  unsigned long chain;
+} il_bucket_t;
+
+// A lock stripe, padded so that no two stripes share a cache line.
+// Writers make version odd while they change a bucket of the stripe, as
+// in the chained table, so get() can read without the lock. The stripe
+// keeps the bucket array its buckets are in, which differs from other
+// stripes' only while the table grows.
+typedef struct il_stripe_t {
+  ts_lock_t lock;
+  unsigned int version;
+  il_bucket_t *buckets;
+  unsigned int capacity;
+} __attribute__((aligned(64))) il_stripe_t;
+
+// Bucket b is guarded by stripes[b % numStripes], and the capacity stays
+// a multiple of numStripes, so that is also the key's stripe and doubling
+// moves entries only between buckets of one stripe. Growing rebuilds one
+// stripe at a time into the new array; a grow that runs out of memory
+// leaves the stripes it did not reach on the previous array, and the next
+// grow finishes them. Overflow nodes come from a slab pool; removed nodes
+// and old arrays are freed through EBR, as a reader may still be on them.
+typedef struct il_table_t {
+  il_stripe_t *stripes;
+  int numStripes;
+  ts_lock_kind_t lockKind;
+  int readTries;
+  double maxLoad;
+  ts_slab_pool_t nodes;
+  pthread_mutex_t growLock;
+  il_bucket_t *buckets;       // changed only under growLock
+  unsigned int capacity;
+  il_bucket_t *previous;      // array of an unfinished grow, else NULL
+} il_table_t;
+
+static __thread unsigned int writesSinceCheck = 0;
+
+static inline il_node_t *il_chain(unsigned long chain)
+{
+  return (il_node_t *)(chain & ~IL_USED);
+}
+
+static inline il_node_t *il_next(unsigned long link)
+{
+  return (il_node_t *)(link & ~IL_COUNT);
+}
+
+static inline int il_count(unsigned long link)
+{
+  return link & IL_COUNT;
+}
+
+static inline il_stripe_t *il_stripe(il_table_t *t, int key)
+{
+  return &t->stripes[((unsigned int)key) % t->numStripes];
+}
+
+static inline il_bucket_t *il_bucket(il_stripe_t *s, int key)
+{
+  return &s->buckets[((unsigned int)key) % s->capacity];
+}
+
+/**
+ * Reads the array and capacity of stripe s without its lock. A grow
+ * stores the array before the capacity, so loading them the other way
+ * round never pairs the old, smaller array with the new capacity.
+ * @return key's bucket, in the old or the new array
+ */
+static inline il_bucket_t *il_bucket_unlocked(il_stripe_t *s, int key)
+{
+  unsigned int capacity = __atomic_load_n(&s->capacity, __ATOMIC_ACQUIRE);
+  il_bucket_t *buckets = __atomic_load_n(&s->buckets, __ATOMIC_ACQUIRE);
+  return &buckets[((unsigned int)key) % capacity];
+}
+
+/**
+ * Marks the start of a change that optimistic readers of stripe s must
+ * not see half done. Caller holds the stripe's lock.
+ */
+static inline void il_write_begin(il_stripe_t *s)
+{
+  __atomic_store_n(&s->version, s->version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void il_write_end(il_stripe_t *s)
+{
+  __atomic_store_n(&s->version, s->version + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Stores key and value in bucket b: inline if it is free, else in the
+ * first overflow node if that has room, else in a new first node. The
+ * caller holds b's stripe and has made sure key is not there.
+ * @return 0, or -1 if a node was needed and none could be allocated
+ */
+static int il_insert(il_table_t *t, il_bucket_t *b, int key, int value)
+{
+  unsigned long chain = b->chain;
+  if (!(chain & IL_USED))
+  {
+    __atomic_store_n(&b->key, key, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->chain, IL_USED, __ATOMIC_RELEASE);
+    return 0;
+  }
+
+  il_node_t *head = il_chain(chain);
+  if (head != NULL && il_count(head->link) < IL_PAIRS)
+  {
+    int n = il_count(head->link);
+    __atomic_store_n(&head->keys[n], key, __ATOMIC_RELAXED);
+    __atomic_store_n(&head->values[n], value, __ATOMIC_RELAXED);
+    __atomic_store_n(&head->link, head->link + 1, __ATOMIC_RELEASE);
+    return 0;
+  }
+
+  il_node_t *node = ts_slab_alloc(&t->nodes);
+  if (node == NULL)
+    return -1;
+  node->keys[0] = key;
+  node->values[0] = value;
+  node->link = (unsigned long)head | 1;
+  __atomic_store_n(&b->chain, (unsigned long)node | IL_USED, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/**
+ * Finds key in bucket b; the caller holds b's stripe
+ * @param node set to the overflow node holding key, or NULL if key is
+ *        inline or absent
+ * @param walked incremented for each entry examined
+ * @return the address of key's value, or NULL if key is absent
+ */
+static int *il_find(il_bucket_t *b, int key, il_node_t **node, int *walked)
+{
+  *node = NULL;
+  if (!(b->chain & IL_USED))
+    return NULL;
+  (*walked)++;
+  if (b->key == key)
+    return &b->value;
+
+  for (il_node_t *n = il_chain(b->chain); n != NULL; n = il_next(n->link))
+  {
+    for (int i = 0; i < il_count(n->link); i++)
+    {
+      (*walked)++;
+      if (n->keys[i] == key)
+      {
+        *node = n;
+        return &n->values[i];
+      }
+    }
+  }
+  return NULL;
+}
+
+static int il_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  il_table_t *t = malloc(sizeof(il_table_t));
+  long stripes = config->stripes > 0 ? config->stripes : IL_STRIPES_PER_CORE * sysconf(_SC_NPROCESSORS_ONLN);
+  long capacity = map->capacity;
+
+  if (stripes < 1 || stripes > capacity)
+    stripes = capacity;
+  capacity = (capacity + stripes - 1) / stripes * stripes;
+  if (t == NULL || capacity > IL_MAX_CAPACITY ||
+      (t->buckets = calloc(capacity, sizeof(il_bucket_t))) == NULL ||
+      (t->stripes = aligned_alloc(64, sizeof(il_stripe_t) * stripes)) == NULL)
+  {
+    if (t != NULL)
+      free(t->buckets);
+    free(t);
+    return -1;
+  }
+
+  for (int i = 0; i < stripes; i++)
+  {
+    ts_lock_init(&t->stripes[i].lock, config->lock);
+    t->stripes[i].version = 0;
+    t->stripes[i].buckets = t->buckets;
+    t->stripes[i].capacity = capacity;
+  }
+  t->numStripes = stripes;
+  t->lockKind = config->lock;
+  t->readTries = config->readTries != 0 ? config->readTries : IL_READ_TRIES;
+  t->maxLoad = config->maxLoad != 0 ? config->maxLoad : IL_MAX_LOAD;
+  ts_slab_pool_init(&t->nodes, sizeof(il_node_t));
+  pthread_mutex_init(&t->growLock, NULL);
+  t->capacity = capacity;
+  t->previous = NULL;
+  map->impl = t;
+  map->capacity = capacity;
+  return 0;
+}
+
+/**
+ * Copies the entries of stripe s from old into buckets, with fresh
+ * overflow nodes. The caller holds the stripe, which is still on old, so
+ * no reader can reach its new buckets yet.
+ * @return 0, or -1 if a node could not be allocated, in which case the
+ *         stripe's new buckets are left empty again
+ */
+static int il_copy_stripe(il_table_t *t, int s, il_bucket_t *old, unsigned int oldCapacity,
+                          il_bucket_t *buckets, unsigned int capacity)
+{
+  int failed = 0;
+  for (unsigned int i = s; i < oldCapacity && !failed; i += t->numStripes)
+  {
+    il_bucket_t *b = &old[i];
+    if (!(b->chain & IL_USED))
+      continue;
+    failed = il_insert(t, &buckets[((unsigned int)b->key) % capacity], b->key, b->value);
+    for (il_node_t *node = il_chain(b->chain); node != NULL && !failed; node = il_next(node->link))
+    {
+      for (int p = 0; p < il_count(node->link) && !failed; p++)
+        failed = il_insert(t, &buckets[((unsigned int)node->keys[p]) % capacity], node->keys[p], node->values[p]);
+    }
+  }
+  if (!failed)
+    return 0;
+
+  for (unsigned int i = s; i < capacity; i += t->numStripes)
+  {
+    for (il_node_t *node = il_chain(buckets[i].chain); node != NULL;)
+    {
+      il_node_t *next = il_next(node->link);
+      ts_slab_free(node);
+      node = next;
+    }
+    buckets[i].chain = 0;
+  }
+  return -1;
+}
+
+/**
+ * Doubles the bucket array unless another thread has since oldCapacity
+ * was read. Each stripe in turn copies its entries into the new array
+ * under its lock, its version odd throughout so that no optimistic read
+ * across the copy validates. Its old nodes are retired once the stripe
+ * has switched arrays, since until then a reader entering EBR can still
+ * reach them; the old array is retired once every stripe has left it.
+ * If a copy runs out of memory, the grow stops there and the next call
+ * picks up at that stripe, whatever oldCapacity it is given. A thread
+ * that finds a grow under way leaves it be.
+ */
+static void il_grow(ts_hashmap_t *map, il_table_t *t, unsigned int oldCapacity)
+{
+  if (pthread_mutex_trylock(&t->growLock) != 0)
+    return;
+
+  if (t->previous == NULL)
+  {
+    il_bucket_t *buckets;
+    if (t->capacity != oldCapacity || oldCapacity >= IL_MAX_CAPACITY ||
+        (buckets = calloc(oldCapacity * 2, sizeof(il_bucket_t))) == NULL)
+    {
+      pthread_mutex_unlock(&t->growLock);
+      return;
+    }
+    t->previous = t->buckets;
+    t->buckets = buckets;
+    t->capacity = oldCapacity * 2;
+  }
+
+  il_bucket_t *old = t->previous;
+  il_bucket_t *buckets = t->buckets;
+  unsigned int capacity = t->capacity;
+  oldCapacity = capacity / 2;
+  for (int s = 0; s < t->numStripes; s++)
+  {
+    il_stripe_t *stripe = &t->stripes[s];
+    if (stripe->buckets == buckets)
+      continue; // Moved by an earlier, interrupted grow
+
+    ts_lock(&stripe->lock, t->lockKind);
+    il_write_begin(stripe);
+    if (il_copy_stripe(t, s, old, oldCapacity, buckets, capacity) < 0)
+    {
+      il_write_end(stripe);
+      ts_unlock(&stripe->lock, t->lockKind);
+      pthread_mutex_unlock(&t->growLock);
+      return;
+    }
+    // Array first: see il_bucket_unlocked()
+    __atomic_store_n(&stripe->buckets, buckets, __ATOMIC_RELEASE);
+    __atomic_store_n(&stripe->capacity, capacity, __ATOMIC_RELEASE);
+    il_write_end(stripe);
+
+    for (unsigned int i = s; i < oldCapacity; i += t->numStripes)
+    {
+      for (il_node_t *node = il_chain(old[i].chain); node != NULL;)
+      {
+        il_node_t *next = il_next(node->link);
+        ts_slab_hold(node);
+        ts_ebr_retire(node, ts_slab_release);
+        node = next;
+      }
+    }
+    ts_unlock(&stripe->lock, t->lockKind);
+  }
+
+  t->previous = NULL;
+  __atomic_store_n(&map->capacity, (int)capacity, __ATOMIC_RELAXED);
+  ts_ebr_retire(old, NULL);
+  pthread_mutex_unlock(&t->growLock);
+}
+
+/**
+ * Looks key up without taking its stripe's lock, inside an EBR section.
+ * The stripe's version tells afterwards whether what it read was
+ * consistent.
+ * @param value where to store the value, or INT_MAX if key was not found
+ * @param walked where to store the number of entries examined
+ * @return 1 if the read validated, 0 if a writer got in the way
+ */
+static int il_get_optimistic(il_stripe_t *s, int key, int *value, int *walked)
+{
+  unsigned int before = __atomic_load_n(&s->version, __ATOMIC_ACQUIRE);
+  if (before & 1)
+    return 0;
+
+  il_bucket_t *b = il_bucket_unlocked(s, key);
+  unsigned long chain = __atomic_load_n(&b->chain, __ATOMIC_ACQUIRE);
+  *value = INT_MAX;
+  *walked = 0;
+
+  if (chain & IL_USED)
+  {
+    *walked = 1;
+    if (__atomic_load_n(&b->key, __ATOMIC_RELAXED) == key)
+    {
+      *value = __atomic_load_n(&b->value, __ATOMIC_RELAXED);
+    }
+    else
+    {
+      il_node_t *node = il_chain(chain);
+      while (node != NULL && *value == INT_MAX)
+      {
+        unsigned long link = __atomic_load_n(&node->link, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < il_count(link); i++)
+        {
+          (*walked)++;
+          if (__atomic_load_n(&node->keys[i], __ATOMIC_RELAXED) == key)
+          {
+            *value = __atomic_load_n(&node->values[i], __ATOMIC_RELAXED);
+            break;
+          }
+        }
+        node = il_next(link);
+      }
+    }
+  }
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->version, __ATOMIC_RELAXED) == before;
+}
+
+static int il_get(ts_hashmap_t *map, int key)
+{
+  il_table_t *t = map->impl;
+  il_stripe_t *s = il_stripe(t, key);
+  int value = INT_MAX;
+  int walked = 0;
+  int done = 0;
+
+  ts_ebr_enter();
+  for (int attempt = 0; attempt < t->readTries && !done; attempt++)
+    done = il_get_optimistic(s, key, &value, &walked);
+  ts_ebr_exit();
+
+  if (!done) // Too much churn on this stripe: wait for the writers instead
+  {
+    il_node_t *node;
+    ts_lock(&s->lock, t->lockKind);
+    walked = 0;
+    int *slot = il_find(il_bucket(s, key), key, &node, &walked);
+    value = slot != NULL ? *slot : INT_MAX;
+    ts_unlock(&s->lock, t->lockKind);
+  }
+
+  ts_counters_t *c = ts_counters(map);
+  __atomic_fetch_add(value != INT_MAX ? &c->hits : &c->misses, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&c->chainSteps, walked, __ATOMIC_RELAXED);
+  return value; // INT_MAX if not found
+}
+
+/**
+ * Starts loading key's bucket, which holds its first entry
+ */
+static void il_prefetch(ts_hashmap_t *map, int key)
+{
+  // Across a grow this may load the old bucket, which only wastes it
+  __builtin_prefetch(il_bucket_unlocked(il_stripe(map->impl, key), key));
+}
+
+static int il_put(ts_hashmap_t *map, int key, int value)
+{
+  il_table_t *t = map->impl;
+  il_stripe_t *s = il_stripe(t, key);
+  int returnVal = INT_MAX;
+  il_node_t *node;
+  int walked = 0;
+
+  ts_lock(&s->lock, t->lockKind);
+  il_bucket_t *b = il_bucket(s, key);
+  int *slot = il_find(b, key, &node, &walked);
+
+  if (slot != NULL) // Key exists, replace the value
+  {
+    returnVal = *slot;
+    __atomic_store_n(slot, value, __ATOMIC_RELAXED);
+    ts_unlock(&s->lock, t->lockKind);
+    TS_COUNT(map, updates);
+    return returnVal;
+  }
+
+  il_write_begin(s);
+  int failed = il_insert(t, b, key, value);
+  il_write_end(s);
+  unsigned int capacity = s->capacity;
+  ts_unlock(&s->lock, t->lockKind);
+  if (failed)
+    return TS_PUT_FAILED;
+
+  TS_COUNT(map, inserts);
+  if (t->maxLoad > 0 && (++writesSinceCheck % TS_LOAD_CHECK) == 0 &&
+      ts_count_size(map) > capacity * t->maxLoad)
+    il_grow(map, t, capacity);
+  return INT_MAX;
+}
+
+static int il_del(ts_hashmap_t *map, int key)
+{
+  il_table_t *t = map->impl;
+  il_stripe_t *s = il_stripe(t, key);
+  il_node_t *removed = NULL;
+  int returnVal = INT_MAX;
+  il_node_t *node;
+  int walked = 0;
+
+  ts_lock(&s->lock, t->lockKind);
+  il_bucket_t *b = il_bucket(s, key);
+  int *slot = il_find(b, key, &node, &walked);
+  if (slot != NULL)
+  {
+    // Fill the hole with the last pair of the first overflow node, or
+    // free the bucket if there is none
+    il_node_t *head = il_chain(b->chain);
+    returnVal = *slot;
+    il_write_begin(s);
+    if (head == NULL)
+    {
+      __atomic_store_n(&b->chain, 0, __ATOMIC_RELEASE);
+    }
+    else
+    {
+      int last = il_count(head->link) - 1;
+      int *keySlot = node != NULL ? &node->keys[slot - node->values] : &b->key;
+      __atomic_store_n(keySlot, head->keys[last], __ATOMIC_RELAXED);
+      __atomic_store_n(slot, head->values[last], __ATOMIC_RELAXED);
+      if (last == 0)
+      {
+        __atomic_store_n(&b->chain, (unsigned long)il_next(head->link) | IL_USED, __ATOMIC_RELEASE);
+        removed = head;
+      }
+      else
+      {
+        __atomic_store_n(&head->link, head->link - 1, __ATOMIC_RELEASE);
+      }
+    }
+    il_write_end(s);
+  }
+  ts_unlock(&s->lock, t->lockKind);
+
+  if (removed != NULL)
+  {
+    ts_slab_hold(removed);
+    ts_ebr_retire(removed, ts_slab_release);
+  }
+  if (slot != NULL)
+    TS_COUNT(map, deletes);
+  else
+    TS_COUNT(map, delMisses);
+  return returnVal; // INT_MAX if not found
+}
+
+static void il_print(ts_hashmap_t *map)
+{
+  il_table_t *t = map->impl;
+  for (unsigned int i = 0; i < t->capacity; i++)
+  {
+    // After an unfinished grow, some stripes are still on the smaller array
+    il_stripe_t *stripe = &t->stripes[i % t->numStripes];
+    if (i >= stripe->capacity)
+      continue;
+    il_bucket_t *b = &stripe->buckets[i];
+    printf("[%u] -> ", i);
+    if (b->chain & IL_USED)
+    {
+      printf("(%d,%d) ", b->key, b->value);
+      for (il_node_t *node = il_chain(b->chain); node != NULL; node = il_next(node->link))
+      {
+        for (int p = 0; p < il_count(node->link); p++)
+          printf("(%d,%d) ", node->keys[p], node->values[p]);
+      }
+    }
+    printf("\n");
+  }
+}
+
+static void il_free(ts_hashmap_t *map)
+{
+  il_table_t *t = map->impl;
+  for (int i = 0; i < t->numStripes; i++)
+    ts_lock_destroy(&t->stripes[i].lock, t->lockKind);
+  // The nodes go with their slabs, without walking the chains
+  ts_slab_pool_destroy(&t->nodes);
+  pthread_mutex_destroy(&t->growLock);
+  free(t->stripes);
+  free(t->buckets);
+  free(t->previous);
+  free(t);
+}
+
+/**
+ * Probe length is the key's position in its bucket, 1 for the inline
+ * entry. Takes one stripe at a time, so each bucket is consistent but
+ * the whole is not a snapshot.
+ */
+static void il_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  il_table_t *t = map->impl;
+  long totalProbe = 0;
+  long entries = 0;
+
+  for (int s = 0; s < t->numStripes; s++)
+  {
+    il_stripe_t *stripe = &t->stripes[s];
+    ts_lock(&stripe->lock, t->lockKind);
+    for (unsigned int i = s; i < stripe->capacity; i += t->numStripes)
+    {
+      il_bucket_t *b = &stripe->buckets[i];
+      int probe = 0;
+      if (b->chain & IL_USED)
+      {
+        probe = 1;
+        totalProbe += probe;
+        entries++;
+        for (il_node_t *node = il_chain(b->chain); node != NULL; node = il_next(node->link))
+        {
+          for (int p = 0; p < il_count(node->link); p++)
+          {
+            probe++;
+            totalProbe += probe;
+            entries++;
+          }
+        }
+      }
+      if (probe > stats->maxProbe)
+        stats->maxProbe = probe;
+    }
+    ts_unlock(&stripe->lock, t->lockKind);
+  }
+
+  if (entries > 0)
+    stats->meanProbe = (double)totalProbe / entries;
+  stats->retired = ts_ebr_pending();
+  stats->retiredBound = -1;
+}
+
+const ts_ops_t ts_inline_ops = {
+  .init = il_init,
+  .get = il_get,
+  .put = il_put,
+  .del = il_del,
+  .print = il_print,
+  .free = il_free,
+  .stats = il_stats,
+  .prefetch = il_prefetch,
+};
@@ -0,0 +1,145 @@
+#include <limits.h>
+#include <stdlib.h>
+#include "ts_hashmap.h"
+#include "ts_ebr.h"
+#include "ts_list.h"
+
+static inline int is_marked(ts_list_node_t *p)
+{
+  return ((unsigned long)p & 1) != 0;
+}
+
+/**
+ * Finds where order belongs in the list at head, unlinking any removed
+ * nodes on the way.
+ * @param prev set to the link that points at *cur
+ * @param cur set to the first live node not ordered before order, or NULL
+ * @return 1 if *cur has exactly this order
+ */
+int ts_list_find(ts_list_node_t **head, unsigned long long order, ts_list_node_t ***prev, ts_list_node_t **cur)
+{
+retry:
+  *prev = head;
+  *cur = __atomic_load_n(*prev, __ATOMIC_ACQUIRE);
+  while (*cur != NULL)
+  {
+    ts_list_node_t *next = __atomic_load_n(&(*cur)->next, __ATOMIC_ACQUIRE);
+    if (is_marked(next)) // Unlink it; only the thread that does so retires it
+    {
+      if (!__atomic_compare_exchange_n(*prev, cur, ts_list_unmarked(next), 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        goto retry;
+      ts_ebr_retire(*cur, NULL);
+      *cur = ts_list_unmarked(next);
+      continue;
+    }
+    if (__atomic_load_n(&(*cur)->cell, __ATOMIC_ACQUIRE) & TS_LIST_REMOVED)
+    {
+      // Deleted but still linked: freeze its next pointer, then unlink it
+      // on the next pass through the loop
+      __atomic_compare_exchange_n(&(*cur)->next, &next, (ts_list_node_t *)((unsigned long)next | 1), 0,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+      continue;
+    }
+    if ((*cur)->order >= order)
+      return (*cur)->order == order;
+    *prev = &(*cur)->next;
+    *cur = next;
+  }
+  return 0;
+}
+
+/**
+ * Looks order up without changing the list: removed nodes keep their
+ * next pointer, so passing through one still leads on down the list
+ * @param walked incremented for each node examined
+ * @return the value, or INT_MAX if order is not in the list
+ */
+int ts_list_get(ts_list_node_t **head, unsigned long long order, int *walked)
+{
+  ts_list_node_t *cur = __atomic_load_n(head, __ATOMIC_ACQUIRE);
+  while (cur != NULL && cur->order <= order)
+  {
+    (*walked)++;
+    if (cur->order == order)
+    {
+      unsigned long long cell = __atomic_load_n(&cur->cell, __ATOMIC_ACQUIRE);
+      if (!(cell & TS_LIST_REMOVED))
+        return (int)(unsigned int)cell;
+    }
+    cur = ts_list_unmarked(__atomic_load_n(&cur->next, __ATOMIC_ACQUIRE));
+  }
+  return INT_MAX;
+}
+
+/**
+ * Stores value under order, with key, in the list at head
+ * @param inserted set to 1 if a node was added, else left alone
+ * @return the old value, INT_MAX if order was new, or TS_PUT_FAILED if
+ *         the node could not be allocated
+ */
+int ts_list_put(ts_list_node_t **head, unsigned long long order, int key, int value, int *inserted)
+{
+  ts_list_node_t *node = NULL;
+  ts_list_node_t **prev;
+  ts_list_node_t *cur;
+
+  while (1)
+  {
+    if (ts_list_find(head, order, &prev, &cur)) // Key exists, replace the value
+    {
+      unsigned long long cell = __atomic_load_n(&cur->cell, __ATOMIC_ACQUIRE);
+      if (cell & TS_LIST_REMOVED)
+        continue;
+      if (__atomic_compare_exchange_n(&cur->cell, &cell, (unsigned int)value, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      {
+        free(node);
+        return (int)(unsigned int)cell;
+      }
+      continue;
+    }
+
+    if (node == NULL)
+    {
+      if ((node = malloc(sizeof(ts_list_node_t))) == NULL)
+        return TS_PUT_FAILED;
+      node->order = order;
+      node->cell = (unsigned int)value;
+      node->key = key;
+    }
+    node->next = cur;
+    if (__atomic_compare_exchange_n(prev, &cur, node, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      break;
+  }
+  *inserted = 1;
+  return INT_MAX;
+}
+
+/**
+ * Removes order from the list at head
+ * @param removed set to 1 if a node was removed, else left alone
+ * @return the value it had, or INT_MAX if order was not in the list
+ */
+int ts_list_del(ts_list_node_t **head, unsigned long long order, int *removed)
+{
+  ts_list_node_t **prev;
+  ts_list_node_t *cur;
+
+  while (ts_list_find(head, order, &prev, &cur))
+  {
+    // Setting TS_LIST_REMOVED is the delete; ts_list_find() then unlinks
+    // the node
+    unsigned long long cell = __atomic_load_n(&cur->cell, __ATOMIC_ACQUIRE);
+    if (cell & TS_LIST_REMOVED)
+      continue;
+    if (__atomic_compare_exchange_n(&cur->cell, &cell, cell | TS_LIST_REMOVED, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+      ts_list_find(head, order, &prev, &cur);
+      *removed = 1;
+      return (int)(unsigned int)cell;
+    }
+  }
+  return INT_MAX; // Key not found
+}
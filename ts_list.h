@@ -0,0 +1,36 @@
+#ifndef TS_LIST_H_
+#define TS_LIST_H_
+
+// Harris-Michael lock-free linked lists of key/value nodes sorted by an
+// order the caller derives from the key, shared by the lockfree and
+// splitorder backends. Lists change only by CAS on next pointers, so a
+// thread descheduled mid-operation never holds up another. A delete
+// first sets TS_LIST_REMOVED in the cell, which is the delete, then marks
+// the low bit of next so nothing can be linked after the node, and
+// unlinks it.
+//
+// Every call runs inside an EBR section; unlinked nodes are freed through
+// EBR, as a reader may still be walking through them. A list is reached
+// through a head link: a bucket pointer, or the next field of a node
+// that stays in the list, such as a split-order bucket marker.
+
+#define TS_LIST_REMOVED (1ull << 32)
+
+typedef struct ts_list_node_t {
+   unsigned long long order;     // what the list is sorted by, unique per key
+   unsigned long long cell;      // value in the low 32 bits, plus TS_LIST_REMOVED
+   struct ts_list_node_t *next;  // low bit set once the node is being unlinked
+   int key;
+} ts_list_node_t;
+
+static inline ts_list_node_t *ts_list_unmarked(ts_list_node_t *p)
+{
+   return (ts_list_node_t *)((unsigned long)p & ~1ul);
+}
+
+int ts_list_find(ts_list_node_t**, unsigned long long, ts_list_node_t***, ts_list_node_t**);
+int ts_list_get(ts_list_node_t**, unsigned long long, int*);
+int ts_list_put(ts_list_node_t**, unsigned long long, int, int, int*);
+int ts_list_del(ts_list_node_t**, unsigned long long, int*);
+
+#endif /* TS_LIST_H_ */
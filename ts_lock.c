@@ -0,0 +1,54 @@
+#include <string.h>
+#include "ts_lock.h"
+
+__thread ts_mcs_node_t ts_mcs_self;
+
+static const char *lockNames[TS_NUM_LOCKS] = {
+  [TS_LOCK_MUTEX] = "mutex",
+  [TS_LOCK_TTAS] = "ttas",
+  [TS_LOCK_TICKET] = "ticket",
+  [TS_LOCK_MCS] = "mcs",
+};
+
+/**
+ * Sets up an unlocked lock for the given policy
+ */
+void ts_lock_init(ts_lock_t *s, ts_lock_kind_t kind)
+{
+  memset(s, 0, sizeof(ts_lock_t));
+  if (kind == TS_LOCK_MUTEX)
+    pthread_mutex_init(&s->mutex, NULL);
+}
+
+void ts_lock_destroy(ts_lock_t *s, ts_lock_kind_t kind)
+{
+  if (kind == TS_LOCK_MUTEX)
+    pthread_mutex_destroy(&s->mutex);
+}
+
+/**
+ * Returns the short name of a lock policy, as accepted by ts_lock_parse()
+ */
+const char *ts_lock_name(ts_lock_kind_t kind)
+{
+  return lockNames[kind];
+}
+
+/**
+ * Looks up a lock policy by its short name
+ * @param name a name such as "mutex" or "mcs"
+ * @param kind where to store the matching policy
+ * @return 0 on success, or -1 if no policy has that name
+ */
+int ts_lock_parse(const char *name, ts_lock_kind_t *kind)
+{
+  for (int i = 0; i < TS_NUM_LOCKS; i++)
+  {
+    if (strcmp(name, lockNames[i]) == 0)
+    {
+      *kind = i;
+      return 0;
+    }
+  }
+  return -1;
+}
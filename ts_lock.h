@@ -0,0 +1,147 @@
+#ifndef TS_LOCK_H_
+#define TS_LOCK_H_
+
+#include <pthread.h>
+#include <sched.h>
+
+#define TS_SPIN_LIMIT 1024   // spins before a waiter yields its core
+
+// How the chained table's lock stripes are taken, chosen per map through
+// ts_config_t.lock. Its critical sections are a few dozen nanoseconds, so
+// the spinning policies skip the futex path; they differ in how they
+// hold up as more threads wait on one stripe.
+typedef enum ts_lock_kind_t {
+   TS_LOCK_MUTEX = 0,    // pthread_mutex_t
+   TS_LOCK_TTAS,         // test-and-test-and-set spinlock
+   TS_LOCK_TICKET,       // FIFO ticket lock, all waiters spin on one word
+   TS_LOCK_MCS,          // MCS queue lock, each waiter spins on its own node
+   TS_NUM_LOCKS
+} ts_lock_kind_t;
+
+// A waiter's place in an MCS queue. The map never has a thread hold two
+// locks at once, so one node per thread is enough.
+typedef struct ts_mcs_node_t {
+   struct ts_mcs_node_t *next;
+   int locked;
+} ts_mcs_node_t;
+
+// A lock under any of the policies. Callers pad it as they need.
+typedef struct ts_lock_t {
+   union {
+      pthread_mutex_t mutex;
+      int flag;
+      struct {
+         unsigned int next;
+         unsigned int owner;
+      } ticket;
+      ts_mcs_node_t *tail;
+   };
+} ts_lock_t;
+
+extern __thread ts_mcs_node_t ts_mcs_self;
+
+void ts_lock_init(ts_lock_t*, ts_lock_kind_t);
+void ts_lock_destroy(ts_lock_t*, ts_lock_kind_t);
+const char *ts_lock_name(ts_lock_kind_t);
+int ts_lock_parse(const char*, ts_lock_kind_t*);
+
+/**
+ * Backs off while spinning; after TS_SPIN_LIMIT spins, yields instead, so
+ * a waiter does not burn the time slice of a preempted holder.
+ */
+static inline void ts_spin(int *spins)
+{
+  if (++*spins < TS_SPIN_LIMIT)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+  }
+  else
+  {
+    *spins = 0;
+    sched_yield();
+  }
+}
+
+static inline void ts_lock(ts_lock_t *s, ts_lock_kind_t kind)
+{
+  int spins = 0;
+
+  switch (kind)
+  {
+  case TS_LOCK_TTAS:
+    // Spin on a plain load, so waiters share the line until it is freed
+    while (__atomic_exchange_n(&s->flag, 1, __ATOMIC_ACQUIRE))
+    {
+      while (__atomic_load_n(&s->flag, __ATOMIC_RELAXED))
+        ts_spin(&spins);
+    }
+    break;
+
+  case TS_LOCK_TICKET:
+  {
+    unsigned int mine = __atomic_fetch_add(&s->ticket.next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&s->ticket.owner, __ATOMIC_ACQUIRE) != mine)
+      ts_spin(&spins);
+    break;
+  }
+
+  case TS_LOCK_MCS:
+  {
+    ts_mcs_node_t *self = &ts_mcs_self;
+    self->next = NULL;
+    __atomic_store_n(&self->locked, 1, __ATOMIC_RELAXED);
+    ts_mcs_node_t *pred = __atomic_exchange_n(&s->tail, self, __ATOMIC_ACQ_REL);
+    if (pred != NULL) // Queue behind pred and wait for it to hand over
+    {
+      __atomic_store_n(&pred->next, self, __ATOMIC_RELEASE);
+      while (__atomic_load_n(&self->locked, __ATOMIC_ACQUIRE))
+        ts_spin(&spins);
+    }
+    break;
+  }
+
+  default:
+    pthread_mutex_lock(&s->mutex);
+  }
+}
+
+static inline void ts_unlock(ts_lock_t *s, ts_lock_kind_t kind)
+{
+  switch (kind)
+  {
+  case TS_LOCK_TTAS:
+    __atomic_store_n(&s->flag, 0, __ATOMIC_RELEASE);
+    break;
+
+  case TS_LOCK_TICKET:
+    // Only the holder writes owner
+    __atomic_store_n(&s->ticket.owner, s->ticket.owner + 1, __ATOMIC_RELEASE);
+    break;
+
+  case TS_LOCK_MCS:
+  {
+    ts_mcs_node_t *self = &ts_mcs_self;
+    ts_mcs_node_t *next = __atomic_load_n(&self->next, __ATOMIC_ACQUIRE);
+    if (next == NULL)
+    {
+      ts_mcs_node_t *expected = self;
+      if (__atomic_compare_exchange_n(&s->tail, &expected, NULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return; // Nobody waiting
+      int spins = 0;
+      while ((next = __atomic_load_n(&self->next, __ATOMIC_ACQUIRE)) == NULL)
+        ts_spin(&spins); // A waiter swapped in but has not linked itself yet
+    }
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+    break;
+  }
+
+  default:
+    pthread_mutex_unlock(&s->mutex);
+  }
+}
+
+#endif /* TS_LOCK_H_ */
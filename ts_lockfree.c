@@ -0,0 +1,161 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ts_backend.h"
+#include "ts_ebr.h"
+#include "ts_list.h"
+
+// The chained layout without locks: each bucket is a lock-free sorted
+// list (ts_list.h). The bucket count is fixed at the initial capacity;
+// past that, chains grow and operations slow down linearly. The
+// splitorder backend is the lock-free layout that grows.
+//
+// Every operation runs in an EBR section; unlinked nodes are freed
+// through EBR, as a reader may still be walking through them.
+typedef struct lf_table_t {
+  int capacity;
+  ts_list_node_t *buckets[];
+} lf_table_t;
+
+/**
+ * A key's place in its bucket's list: keys sort as signed ints
+ */
+static inline unsigned long long lf_order(int key)
+{
+  return (unsigned int)key ^ 0x80000000u;
+}
+
+static int lf_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  lf_table_t *t = calloc(1, sizeof(lf_table_t) + sizeof(ts_list_node_t *) * map->capacity);
+  if (t == NULL)
+    return -1;
+  t->capacity = map->capacity;
+  map->impl = t;
+  return 0;
+}
+
+static inline ts_list_node_t **lf_bucket(lf_table_t *t, int key)
+{
+  return &t->buckets[((unsigned int)key) % t->capacity];
+}
+
+static int lf_get(ts_hashmap_t *map, int key)
+{
+  lf_table_t *t = map->impl;
+  ts_counters_t *c = ts_counters(map);
+  int walked = 0;
+  ts_ebr_enter();
+  int value = ts_list_get(lf_bucket(t, key), lf_order(key), &walked);
+  ts_ebr_exit();
+
+  __atomic_fetch_add(value != INT_MAX ? &c->hits : &c->misses, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&c->chainSteps, walked, __ATOMIC_RELAXED);
+  return value; // INT_MAX if not found
+}
+
+static int lf_put(ts_hashmap_t *map, int key, int value)
+{
+  lf_table_t *t = map->impl;
+  int inserted = 0;
+  ts_ebr_enter();
+  int returnVal = ts_list_put(lf_bucket(t, key), lf_order(key), key, value, &inserted);
+  ts_ebr_exit();
+
+  if (inserted)
+    TS_COUNT(map, inserts);
+  else if (returnVal != TS_PUT_FAILED)
+    TS_COUNT(map, updates);
+  return returnVal;
+}
+
+static int lf_del(ts_hashmap_t *map, int key)
+{
+  lf_table_t *t = map->impl;
+  int removed = 0;
+  ts_ebr_enter();
+  int returnVal = ts_list_del(lf_bucket(t, key), lf_order(key), &removed);
+  ts_ebr_exit();
+
+  if (removed)
+    TS_COUNT(map, deletes);
+  else
+    TS_COUNT(map, delMisses);
+  return returnVal; // INT_MAX if not found
+}
+
+static void lf_print(ts_hashmap_t *map)
+{
+  lf_table_t *t = map->impl;
+  for (int i = 0; i < t->capacity; i++)
+  {
+    printf("[%d] -> ", i);
+    for (ts_list_node_t *node = t->buckets[i]; node != NULL; node = ts_list_unmarked(node->next))
+    {
+      if (!(node->cell & TS_LIST_REMOVED))
+        printf("(%d,%d) ", node->key, (int)(unsigned int)node->cell);
+    }
+    printf("\n");
+  }
+}
+
+static void lf_free(ts_hashmap_t *map)
+{
+  lf_table_t *t = map->impl;
+  for (int i = 0; i < t->capacity; i++)
+  {
+    ts_list_node_t *node = t->buckets[i];
+    while (node != NULL)
+    {
+      ts_list_node_t *next = ts_list_unmarked(node->next);
+      free(node);
+      node = next;
+    }
+  }
+  free(t);
+}
+
+/**
+ * Probe length is the key's position among the live keys of its bucket.
+ * Reads without stopping writers, so under concurrent updates the
+ * numbers are approximate.
+ */
+static void lf_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  lf_table_t *t = map->impl;
+  long totalProbe = 0;
+  int entries = 0;
+
+  ts_ebr_enter();
+  for (int i = 0; i < t->capacity; i++)
+  {
+    int probe = 0;
+    for (ts_list_node_t *node = __atomic_load_n(&t->buckets[i], __ATOMIC_ACQUIRE); node != NULL;
+         node = ts_list_unmarked(__atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+    {
+      if (__atomic_load_n(&node->cell, __ATOMIC_ACQUIRE) & TS_LIST_REMOVED)
+        continue;
+      probe++;
+      totalProbe += probe;
+      entries++;
+    }
+    if (probe > stats->maxProbe)
+      stats->maxProbe = probe;
+  }
+  ts_ebr_exit();
+
+  if (entries > 0)
+    stats->meanProbe = (double)totalProbe / entries;
+  stats->retired = ts_ebr_pending();
+  stats->retiredBound = -1;
+}
+
+const ts_ops_t ts_lockfree_ops = {
+  .init = lf_init,
+  .get = lf_get,
+  .put = lf_put,
+  .del = lf_del,
+  .print = lf_print,
+  .free = lf_free,
+  .stats = lf_stats,
+};
@@ -0,0 +1,543 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ts_backend.h"
+#include "ts_ebr.h"
+
+#define OA_EMPTY INT_MIN   // key value that marks an unused slot
+#define OA_LINE 64         // arrays are aligned to and padded to a cache line
+#define OA_MIN_BITS 3
+#define OA_READ_TRIES 4    // optimistic attempts before get() takes the lock
+#define RH_FAR 255         // recorded for displacements too large for a byte
+
+// An open-addressing table keeps keys and values in two flat arrays
+// (struct of arrays), so a probe sequence scans consecutive keys in the
+// same cache line and only touches the values array on a hit.
+// Collisions are resolved with linear probing. The key OA_EMPTY cannot
+// live in the arrays, so it is stored on the side.
+// The Robin Hood variant also records each slot's displacement from its
+// home slot and keeps every run ordered so that an entry never sits
+// further from home than the one after it. A lookup can then stop as soon
+// as it reaches a slot displaced less than the probe so far, instead of
+// scanning to the next empty slot.
+// The arrays and their geometry are published together, so that growing
+// swaps them in one store and a reader never pairs a mask with the wrong
+// arrays. Replaced ones are freed through EBR.
+typedef struct oa_slots_t {
+  int *keys;
+  int *values;
+  unsigned char *dist;  // Robin Hood only: displacement + 1, or 0 if empty
+  unsigned int mask;    // number of slots - 1, slots is a power of two
+  int shift;            // 32 - log2(slots), for the multiplicative hash
+} oa_slots_t;
+
+// One reader/writer lock serializes writers over the whole table:
+// backward-shift deletion and growth move entries across any slot
+// boundary we might stripe on. get() does not take it. It reads under
+// version, which writers make odd while they move entries, and retries
+// if that changed; only after OA_READ_TRIES does it wait for the lock.
+// Writers store every slot atomically so those reads are never torn.
+typedef struct oa_table_t {
+  oa_slots_t *slots;
+  unsigned int version;
+  int used;             // occupied slots (excludes the OA_EMPTY key)
+  int hasEmptyKey;
+  int emptyKeyValue;
+  int robinHood;
+  pthread_rwlock_t lock;
+} oa_table_t;
+
+/**
+ * Allocates an array of the given size aligned to a cache line
+ */
+static void *oa_alloc(size_t bytes)
+{
+  return aligned_alloc(OA_LINE, (bytes + OA_LINE - 1) & ~(size_t)(OA_LINE - 1));
+}
+
+/**
+ * Home slot of a key: Fibonacci hashing keeps sequential keys from
+ * piling up into one long run of occupied slots.
+ */
+static inline unsigned int oa_home(const oa_slots_t *s, int key)
+{
+  return ((unsigned int)key * 2654435769u) >> s->shift;
+}
+
+static void oa_free_slots(void *p)
+{
+  oa_slots_t *s = p;
+  free(s->keys);
+  free(s->values);
+  free(s->dist);
+  free(s);
+}
+
+/**
+ * Allocates empty arrays of 2^bits slots
+ * @return the arrays, or NULL on allocation failure
+ */
+static oa_slots_t *oa_alloc_slots(int bits, int robinHood)
+{
+  unsigned int slots = 1u << bits;
+  oa_slots_t *s = malloc(sizeof(oa_slots_t));
+  if (s == NULL)
+    return NULL;
+  s->keys = oa_alloc(sizeof(int) * slots);
+  s->values = oa_alloc(sizeof(int) * slots);
+  s->dist = robinHood ? oa_alloc(slots) : NULL;
+  if (s->keys == NULL || s->values == NULL || (robinHood && s->dist == NULL))
+  {
+    oa_free_slots(s);
+    return NULL;
+  }
+  for (unsigned int i = 0; i < slots; i++)
+    s->keys[i] = OA_EMPTY;
+  if (s->dist != NULL)
+    memset(s->dist, 0, slots);
+  s->mask = slots - 1;
+  s->shift = 32 - bits;
+  return s;
+}
+
+/**
+ * Displacement + 1 of the entry in Robin Hood slot i, 0 if it is empty.
+ * Slots record it in a byte; past that it is recomputed from the key.
+ */
+static inline unsigned int rh_dist(const oa_slots_t *s, unsigned int i)
+{
+  unsigned int d = __atomic_load_n(&s->dist[i], __ATOMIC_RELAXED);
+  if (d < RH_FAR)
+    return d;
+  return ((i - oa_home(s, __atomic_load_n(&s->keys[i], __ATOMIC_RELAXED))) & s->mask) + 1;
+}
+
+static inline void rh_set_dist(oa_slots_t *s, unsigned int i, unsigned int d)
+{
+  __atomic_store_n(&s->dist[i], d < RH_FAR ? d : RH_FAR, __ATOMIC_RELAXED);
+}
+
+static inline int oa_key(const oa_slots_t *s, unsigned int i)
+{
+  return __atomic_load_n(&s->keys[i], __ATOMIC_RELAXED);
+}
+
+static inline void oa_set(oa_slots_t *s, unsigned int i, int key, int value)
+{
+  __atomic_store_n(&s->keys[i], key, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->values[i], value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Finds the slot holding key, or the empty slot that ends its probe
+ * sequence. A reader racing a writer may find neither; it gives up after
+ * one pass over the table.
+ */
+static unsigned int oa_find(const oa_slots_t *s, int key)
+{
+  unsigned int i = oa_home(s, key);
+  for (unsigned int n = 0; n <= s->mask; n++)
+  {
+    int k = oa_key(s, i);
+    if (k == key || k == OA_EMPTY)
+      break;
+    i = (i + 1) & s->mask;
+  }
+  return i;
+}
+
+/**
+ * Finds the slot holding key
+ * @return the slot, or -1 if the key is not stored
+ */
+static long oa_lookup(const oa_table_t *t, const oa_slots_t *s, int key)
+{
+  unsigned int i = oa_home(s, key);
+
+  if (!t->robinHood)
+  {
+    i = oa_find(s, key);
+    return oa_key(s, i) == key ? (long)i : -1;
+  }
+
+  // Every entry past a less displaced one would have taken its slot
+  for (unsigned int d = 1; d <= s->mask + 1 && rh_dist(s, i) >= d; d++)
+  {
+    if (oa_key(s, i) == key)
+      return i;
+    i = (i + 1) & s->mask;
+  }
+  return -1;
+}
+
+/**
+ * Stores a key that is not yet in the arrays. A Robin Hood insert hands
+ * each slot to whichever entry is further from home and carries the other
+ * one on.
+ */
+static void oa_place(const oa_table_t *t, oa_slots_t *s, int key, int value)
+{
+  unsigned int i;
+
+  if (!t->robinHood)
+  {
+    oa_set(s, oa_find(s, key), key, value);
+    return;
+  }
+
+  i = oa_home(s, key);
+  for (unsigned int d = 1; ; d++)
+  {
+    unsigned int slotDist = rh_dist(s, i);
+    if (slotDist == 0)
+    {
+      oa_set(s, i, key, value);
+      rh_set_dist(s, i, d);
+      return;
+    }
+    if (slotDist < d) // Take the slot from a richer entry
+    {
+      int tempKey = s->keys[i];
+      int tempValue = s->values[i];
+      oa_set(s, i, key, value);
+      rh_set_dist(s, i, d);
+      key = tempKey;
+      value = tempValue;
+      d = slotDist;
+    }
+    i = (i + 1) & s->mask;
+  }
+}
+
+/**
+ * Empties slot i, shifting the rest of its run back by one where that
+ * does not move an entry in front of its home slot.
+ */
+static void oa_remove(const oa_table_t *t, oa_slots_t *s, unsigned int i)
+{
+  unsigned int j = i;
+  while (1)
+  {
+    j = (j + 1) & s->mask;
+    if (s->keys[j] == OA_EMPTY)
+      break;
+    if (t->robinHood)
+    {
+      unsigned int d = rh_dist(s, j);
+      if (d == 1) // Already at home, and so is the rest of the run
+        break;
+      oa_set(s, i, s->keys[j], s->values[j]);
+      rh_set_dist(s, i, d - 1);
+      i = j;
+      continue;
+    }
+    unsigned int home = oa_home(s, s->keys[j]);
+    if (((j - home) & s->mask) >= ((j - i) & s->mask))
+    {
+      oa_set(s, i, s->keys[j], s->values[j]);
+      i = j;
+    }
+  }
+  __atomic_store_n(&s->keys[i], OA_EMPTY, __ATOMIC_RELAXED);
+  if (t->robinHood)
+    rh_set_dist(s, i, 0);
+}
+
+/**
+ * Marks the start of a change that optimistic readers must not see half
+ * done. Caller holds the write lock.
+ */
+static inline void oa_write_begin(oa_table_t *t)
+{
+  __atomic_store_n(&t->version, t->version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void oa_write_end(oa_table_t *t)
+{
+  __atomic_store_n(&t->version, t->version + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Doubles the number of slots and reinserts every entry into the new
+ * arrays, which are published once full. Readers may still be on the old
+ * ones, so those are retired. Caller holds the write lock.
+ * @return 0 on success, -1 on allocation failure (the table is unchanged)
+ */
+static int oa_grow(oa_table_t *t)
+{
+  oa_slots_t *old = t->slots;
+  oa_slots_t *s = oa_alloc_slots(32 - old->shift + 1, t->robinHood);
+  if (s == NULL)
+    return -1;
+
+  for (unsigned int i = 0; i <= old->mask; i++)
+  {
+    if (old->keys[i] != OA_EMPTY)
+      oa_place(t, s, old->keys[i], old->values[i]);
+  }
+  __atomic_store_n(&t->slots, s, __ATOMIC_RELEASE);
+  ts_ebr_retire(old, oa_free_slots);
+  return 0;
+}
+
+static int oa_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  oa_table_t *t = malloc(sizeof(oa_table_t));
+  int bits = OA_MIN_BITS;
+  while (bits < 30 && (1 << bits) < config->capacity)
+    bits++;
+
+  if (t != NULL)
+    t->robinHood = (config->backend == TS_ROBIN_HOOD);
+  if (t == NULL || (t->slots = oa_alloc_slots(bits, t->robinHood)) == NULL)
+  {
+    free(t);
+    return -1;
+  }
+  t->version = 0;
+  t->used = 0;
+  t->hasEmptyKey = 0;
+  t->emptyKeyValue = 0;
+  pthread_rwlock_init(&t->lock, NULL);
+
+  map->impl = t;
+  map->capacity = t->slots->mask + 1;
+  return 0;
+}
+
+/**
+ * Looks key up without the lock, inside an EBR section
+ * @param value where to store the value, or INT_MAX if key was not found
+ * @return 1 if the read validated, 0 if a writer got in the way
+ */
+static int oa_get_optimistic(oa_table_t *t, int key, int *value)
+{
+  unsigned int before = __atomic_load_n(&t->version, __ATOMIC_ACQUIRE);
+  if (before & 1)
+    return 0;
+
+  *value = INT_MAX;
+  if (key == OA_EMPTY)
+  {
+    if (__atomic_load_n(&t->hasEmptyKey, __ATOMIC_RELAXED))
+      *value = __atomic_load_n(&t->emptyKeyValue, __ATOMIC_RELAXED);
+  }
+  else
+  {
+    oa_slots_t *s = __atomic_load_n(&t->slots, __ATOMIC_ACQUIRE);
+    long i = oa_lookup(t, s, key);
+    if (i >= 0)
+      *value = __atomic_load_n(&s->values[i], __ATOMIC_RELAXED);
+  }
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&t->version, __ATOMIC_RELAXED) == before;
+}
+
+static int oa_get(ts_hashmap_t *map, int key)
+{
+  oa_table_t *t = map->impl;
+  int returnVal = INT_MAX;
+  int done = 0;
+
+  ts_ebr_enter();
+  for (int attempt = 0; attempt < OA_READ_TRIES && !done; attempt++)
+    done = oa_get_optimistic(t, key, &returnVal);
+  ts_ebr_exit();
+
+  if (!done) // Too much churn: wait for the writers instead
+  {
+    pthread_rwlock_rdlock(&t->lock);
+    returnVal = INT_MAX;
+    if (key == OA_EMPTY)
+    {
+      if (t->hasEmptyKey)
+        returnVal = t->emptyKeyValue;
+    }
+    else
+    {
+      long i = oa_lookup(t, t->slots, key);
+      if (i >= 0)
+        returnVal = t->slots->values[i];
+    }
+    pthread_rwlock_unlock(&t->lock);
+  }
+  ts_count_get(map, returnVal);
+  return returnVal;
+}
+
+static int oa_put(ts_hashmap_t *map, int key, int value)
+{
+  oa_table_t *t = map->impl;
+  int returnVal = INT_MAX;
+
+  pthread_rwlock_wrlock(&t->lock);
+  if (key == OA_EMPTY)
+  {
+    if (t->hasEmptyKey)
+    {
+      returnVal = t->emptyKeyValue;
+      TS_COUNT(map, updates);
+    }
+    else
+    {
+      TS_COUNT(map, inserts);
+    }
+    oa_write_begin(t);
+    __atomic_store_n(&t->emptyKeyValue, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->hasEmptyKey, 1, __ATOMIC_RELAXED);
+    oa_write_end(t);
+  }
+  else
+  {
+    oa_slots_t *s = t->slots;
+    long i = oa_lookup(t, s, key);
+    if (i >= 0) // Key exists, replace the value; one store, so no version change
+    {
+      returnVal = s->values[i];
+      __atomic_store_n(&s->values[i], value, __ATOMIC_RELAXED);
+      TS_COUNT(map, updates);
+    }
+    else
+    {
+      // Keep at least 1/32 of the slots free so probes stay short. If the
+      // table cannot grow, it fills up, but one slot always stays empty so
+      // that probes still end.
+      unsigned int slots = s->mask + 1;
+      oa_write_begin(t);
+      if ((unsigned int)t->used + 1 >= slots - slots / 32 && oa_grow(t) == 0)
+      {
+        s = t->slots;
+        map->capacity = slots = s->mask + 1;
+      }
+      if ((unsigned int)t->used + 1 >= slots)
+      {
+        returnVal = TS_PUT_FAILED;
+      }
+      else
+      {
+        oa_place(t, s, key, value);
+        t->used++;
+        TS_COUNT(map, inserts);
+      }
+      oa_write_end(t);
+    }
+  }
+  pthread_rwlock_unlock(&t->lock);
+  return returnVal;
+}
+
+static int oa_del(ts_hashmap_t *map, int key)
+{
+  oa_table_t *t = map->impl;
+  int returnVal = INT_MAX;
+
+  pthread_rwlock_wrlock(&t->lock);
+  if (key == OA_EMPTY)
+  {
+    if (t->hasEmptyKey)
+    {
+      returnVal = t->emptyKeyValue;
+      __atomic_store_n(&t->hasEmptyKey, 0, __ATOMIC_RELAXED);
+      TS_COUNT(map, deletes);
+    }
+    else
+    {
+      TS_COUNT(map, delMisses);
+    }
+  }
+  else
+  {
+    oa_slots_t *s = t->slots;
+    long i = oa_lookup(t, s, key);
+    if (i >= 0)
+    {
+      returnVal = s->values[i];
+      oa_write_begin(t);
+      oa_remove(t, s, i);
+      oa_write_end(t);
+      t->used--;
+      TS_COUNT(map, deletes);
+    }
+    else
+    {
+      TS_COUNT(map, delMisses);
+    }
+  }
+  pthread_rwlock_unlock(&t->lock);
+  return returnVal;
+}
+
+static void oa_print(ts_hashmap_t *map)
+{
+  oa_table_t *t = map->impl;
+  oa_slots_t *s = t->slots;
+  if (t->hasEmptyKey)
+    printf("[-] -> (%d,%d)\n", OA_EMPTY, t->emptyKeyValue);
+  for (unsigned int i = 0; i <= s->mask; i++)
+  {
+    printf("[%u] -> ", i);
+    if (s->keys[i] != OA_EMPTY)
+      printf("(%d,%d)", s->keys[i], s->values[i]);
+    printf("\n");
+  }
+}
+
+static void oa_free(ts_hashmap_t *map)
+{
+  oa_table_t *t = map->impl;
+  pthread_rwlock_destroy(&t->lock);
+  oa_free_slots(t->slots);
+  free(t);
+}
+
+static void oa_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  oa_table_t *t = map->impl;
+  long totalProbe = 0;
+
+  pthread_rwlock_rdlock(&t->lock);
+  oa_slots_t *s = t->slots;
+  for (unsigned int i = 0; i <= s->mask; i++)
+  {
+    if (s->keys[i] == OA_EMPTY)
+      continue;
+    int probe = t->robinHood ? (int)rh_dist(s, i) : (int)((i - oa_home(s, s->keys[i])) & s->mask) + 1;
+    totalProbe += probe;
+    if (probe > stats->maxProbe)
+      stats->maxProbe = probe;
+  }
+  if (t->hasEmptyKey)
+  {
+    totalProbe++;
+    if (stats->maxProbe == 0)
+      stats->maxProbe = 1;
+  }
+  if (t->used + t->hasEmptyKey > 0)
+    stats->meanProbe = (double)totalProbe / (t->used + t->hasEmptyKey);
+  pthread_rwlock_unlock(&t->lock);
+}
+
+const ts_ops_t ts_oa_ops = {
+  .init = oa_init,
+  .get = oa_get,
+  .put = oa_put,
+  .del = oa_del,
+  .print = oa_print,
+  .free = oa_free,
+  .stats = oa_stats,
+};
+
+// Same entry points; oa_init() sees TS_ROBIN_HOOD and sets robinHood
+const ts_ops_t ts_rh_ops = {
+  .init = oa_init,
+  .get = oa_get,
+  .put = oa_put,
+  .del = oa_del,
+  .print = oa_print,
+  .free = oa_free,
+  .stats = oa_stats,
+};
@@ -0,0 +1,284 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "ts_slab.h"
+
+#define SLAB_CACHE 8          // pools a thread remembers its slabs of
+#define SLAB_DEAD (1ul << 63) // set in held once the pool is destroyed
+
+typedef struct slab_node_t {
+  struct slab_node_t *next;
+} slab_node_t;
+
+// Nodes follow the header, packed back to back from the next cache line
+typedef struct ts_slab_t {
+  struct ts_slab_t *next;       // in the pool's list
+  struct ts_slab_t *ownNext;    // ring of the owner's slabs in the pool
+  unsigned long owner;          // id of the thread that allocates from it
+  slab_node_t *freeList;        // owner only
+  slab_node_t *remoteFree;      // pushed by other threads
+  unsigned long held;           // retired nodes not yet freed, plus SLAB_DEAD
+  int nodeSize;
+  int carved;                   // nodes handed out from the untouched tail
+  int capacity;
+} __attribute__((aligned(64))) ts_slab_t;
+
+typedef struct slab_cache_t {
+  unsigned long poolId;
+  ts_slab_t *slab;
+} slab_cache_t;
+
+// A thread id, on a list that only grows. A thread hands its id back as
+// it exits, and the next thread that needs one takes it over along with
+// every slab carved under it, as ts_ebr.c does with its records. Slabs
+// thus outlive their thread without leaking the nodes freed into them.
+typedef struct slab_id_t {
+  unsigned long id;
+  int inUse;
+  struct slab_id_t *next;
+} slab_id_t;
+
+static unsigned long nextPoolId = 1;
+static unsigned long nextThreadId = 1;
+static slab_id_t *ids = NULL;
+static pthread_key_t exitKey;
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static __thread unsigned long selfId = 0;
+static __thread slab_cache_t cache[SLAB_CACHE];
+static __thread int victim = 0;
+
+static inline ts_slab_t *slab_of(void *p)
+{
+  return (ts_slab_t *)((unsigned long)p & ~(unsigned long)(TS_SLAB_BYTES - 1));
+}
+
+/**
+ * Runs when a thread that allocated exits, handing its id back. Forgets
+ * its slabs too, in case a later destructor of the thread allocates and
+ * so claims another id.
+ */
+static void slab_thread_exit(void *arg)
+{
+  slab_id_t *r = arg;
+  for (int i = 0; i < SLAB_CACHE; i++)
+    cache[i].poolId = 0;
+  selfId = 0;
+  __atomic_store_n(&r->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void slab_make_key(void)
+{
+  pthread_key_create(&exitKey, slab_thread_exit);
+}
+
+/**
+ * Claims an id a thread handed back, or a new one if there is none
+ */
+static unsigned long slab_claim_id(void)
+{
+  slab_id_t *self = NULL;
+  pthread_once(&keyOnce, slab_make_key);
+  for (slab_id_t *r = __atomic_load_n(&ids, __ATOMIC_ACQUIRE); r != NULL && self == NULL; r = r->next)
+  {
+    int unused = 0;
+    if (__atomic_load_n(&r->inUse, __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&r->inUse, &unused, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      self = r;
+  }
+
+  if (self == NULL)
+  {
+    self = malloc(sizeof(slab_id_t));
+    self->id = __atomic_fetch_add(&nextThreadId, 1, __ATOMIC_RELAXED);
+    self->inUse = 1;
+    self->next = __atomic_load_n(&ids, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&ids, &self->next, self, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+  }
+  pthread_setspecific(exitKey, self);
+  return self->id;
+}
+
+static inline unsigned long self_id(void)
+{
+  if (selfId == 0)
+    selfId = slab_claim_id();
+  return selfId;
+}
+
+/**
+ * Sets up an empty pool of nodes of the given size
+ */
+void ts_slab_pool_init(ts_slab_pool_t *pool, int nodeSize)
+{
+  pool->slabs = NULL;
+  pool->id = __atomic_fetch_add(&nextPoolId, 1, __ATOMIC_RELAXED);
+  pool->nodeSize = (nodeSize + 7) & ~7;
+}
+
+/**
+ * Releases every slab of the pool, and with them every node still
+ * allocated. Call once no thread uses the pool any more; slabs that still
+ * have held nodes are released with the last of them.
+ */
+void ts_slab_pool_destroy(ts_slab_pool_t *pool)
+{
+  ts_slab_t *slab = pool->slabs;
+  while (slab != NULL)
+  {
+    ts_slab_t *next = slab->next;
+    if (__atomic_fetch_or(&slab->held, SLAB_DEAD, __ATOMIC_ACQ_REL) == 0)
+      free(slab);
+    slab = next;
+  }
+  pool->slabs = NULL;
+}
+
+/**
+ * Carves a new slab for the calling thread and adds it to the pool
+ * @return the slab, or NULL if out of memory
+ */
+static ts_slab_t *slab_new(ts_slab_pool_t *pool)
+{
+  ts_slab_t *slab = aligned_alloc(TS_SLAB_BYTES, TS_SLAB_BYTES);
+  if (slab == NULL)
+    return NULL;
+
+  slab->ownNext = slab;
+  slab->owner = self_id();
+  slab->freeList = NULL;
+  slab->remoteFree = NULL;
+  slab->held = 0;
+  slab->nodeSize = pool->nodeSize;
+  slab->carved = 0;
+  slab->capacity = (TS_SLAB_BYTES - sizeof(ts_slab_t)) / pool->nodeSize;
+  slab->next = __atomic_load_n(&pool->slabs, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&pool->slabs, &slab->next, slab, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+  return slab;
+}
+
+/**
+ * Takes a node from the owner's free list, the untouched tail, or failing
+ * those the nodes other threads freed
+ * @return the node, or NULL if the slab is full
+ */
+static void *slab_take(ts_slab_t *slab)
+{
+  slab_node_t *node = slab->freeList;
+  if (node == NULL && slab->carved < slab->capacity)
+    return (char *)slab + sizeof(ts_slab_t) + (long)slab->nodeSize * slab->carved++;
+  if (node == NULL)
+    node = __atomic_exchange_n(&slab->remoteFree, NULL, __ATOMIC_ACQUIRE);
+  if (node != NULL)
+    slab->freeList = node->next;
+  return node;
+}
+
+/**
+ * The calling thread's most recent slab of the pool: remembered for the
+ * last few pools used, else found by walking the pool's list
+ * @return the cache entry for the pool; its slab is NULL if the thread
+ *         has none yet
+ */
+static slab_cache_t *slab_cached(ts_slab_pool_t *pool)
+{
+  for (int i = 0; i < SLAB_CACHE; i++)
+  {
+    if (cache[i].poolId == pool->id)
+      return &cache[i];
+  }
+
+  slab_cache_t *c = &cache[victim];
+  victim = (victim + 1) % SLAB_CACHE;
+  c->poolId = pool->id;
+  c->slab = NULL;
+  for (ts_slab_t *slab = __atomic_load_n(&pool->slabs, __ATOMIC_ACQUIRE); slab != NULL; slab = slab->next)
+  {
+    if (slab->owner == self_id())
+    {
+      c->slab = slab;
+      break;
+    }
+  }
+  return c;
+}
+
+/**
+ * Allocates a node from one of the calling thread's slabs of the pool.
+ * When the current slab is full, the thread goes round its other slabs
+ * for nodes freed since, and only carves a new slab if there are none.
+ * @return the node, or NULL if out of memory
+ */
+void *ts_slab_alloc(ts_slab_pool_t *pool)
+{
+  slab_cache_t *c = slab_cached(pool);
+  void *p;
+
+  if (c->slab != NULL)
+  {
+    if ((p = slab_take(c->slab)) != NULL)
+      return p;
+    for (ts_slab_t *slab = c->slab->ownNext; slab != c->slab; slab = slab->ownNext)
+    {
+      if ((p = slab_take(slab)) != NULL)
+      {
+        c->slab = slab;
+        return p;
+      }
+    }
+  }
+
+  ts_slab_t *slab = slab_new(pool);
+  if (slab == NULL)
+    return NULL;
+  if (c->slab != NULL) // Join the ring after the current slab
+  {
+    slab->ownNext = c->slab->ownNext;
+    c->slab->ownNext = slab;
+  }
+  c->slab = slab;
+  return slab_take(slab);
+}
+
+/**
+ * Returns a node to its slab: onto the owner's free list if the caller
+ * owns the slab, else onto its remote list
+ */
+void ts_slab_free(void *p)
+{
+  ts_slab_t *slab = slab_of(p);
+  slab_node_t *node = p;
+
+  if (slab->owner == self_id())
+  {
+    node->next = slab->freeList;
+    slab->freeList = node;
+    return;
+  }
+  node->next = __atomic_load_n(&slab->remoteFree, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&slab->remoteFree, &node->next, node, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+}
+
+/**
+ * Keeps p's slab alive past the pool's destruction until p is released.
+ * Call when p is retired for deferred freeing.
+ */
+void ts_slab_hold(void *p)
+{
+  __atomic_fetch_add(&slab_of(p)->held, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Frees a node that was held; fits EBR and hazard pointer destroy
+ * callbacks. The last held node of a destroyed pool's slab frees the slab.
+ */
+void ts_slab_release(void *p)
+{
+  ts_slab_t *slab = slab_of(p);
+  if (!(__atomic_load_n(&slab->held, __ATOMIC_ACQUIRE) & SLAB_DEAD))
+    ts_slab_free(p);
+  if (__atomic_sub_fetch(&slab->held, 1, __ATOMIC_ACQ_REL) == SLAB_DEAD)
+    free(slab);
+}
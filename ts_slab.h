@@ -0,0 +1,33 @@
+#ifndef TS_SLAB_H_
+#define TS_SLAB_H_
+
+// Per-thread slab allocation of fixed-size nodes. A pool hands out nodes
+// of one size, carved from TS_SLAB_BYTES slabs aligned to their own size,
+// so a node's slab is found by masking its address. Each slab belongs to
+// the thread that carved it: only that thread allocates from it, so the
+// fast paths take no lock and no atomic. A node freed by another thread
+// goes on the slab's lock-free remote list, which the owner takes over
+// whole once its own free list runs dry. When the thread exits, the next
+// thread to allocate takes its slabs over.
+//
+// Destroying a pool releases every slab at once instead of freeing nodes
+// one by one. Nodes that were retired through EBR or hazard pointers may
+// still be waiting to be freed then; ts_slab_hold() counts them, and a
+// slab whose pool is gone is released with its last such node.
+
+#define TS_SLAB_BYTES 16384  // bytes per slab, header included
+
+typedef struct ts_slab_pool_t {
+   struct ts_slab_t *slabs;     // every slab carved, by any thread
+   unsigned long id;            // never reused, so thread caches cannot go stale
+   int nodeSize;
+} ts_slab_pool_t;
+
+void ts_slab_pool_init(ts_slab_pool_t*, int);
+void ts_slab_pool_destroy(ts_slab_pool_t*);
+void *ts_slab_alloc(ts_slab_pool_t*);
+void ts_slab_free(void*);
+void ts_slab_hold(void*);
+void ts_slab_release(void*);
+
+#endif /* TS_SLAB_H_ */
@@ -0,0 +1,291 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ts_backend.h"
+#include "ts_ebr.h"
+#include "ts_list.h"
+
+#define SO_LOAD 2            // average keys per bucket before the directory doubles
+#define SO_LEVELS 32         // directory segments; segment l > 0 holds 2^(l-1) buckets
+#define SO_MAX_BUCKETS (1u << 31)
+
+static __thread unsigned int insertsSinceCheck = 0;
+
+// Every key and every bucket marker sits in one lock-free sorted list
+// (ts_list.h), ordered by the reversed hash << 1 with the low bit set for
+// keys. Sorting by the bit-reversed hash keeps the keys of a bucket
+// together and puts them right after their bucket's marker node, so
+// doubling the bucket count splits each bucket in place just by adding
+// new markers; no key ever moves.
+typedef ts_list_node_t so_node_t;
+
+// The directory of bucket markers grows a segment at a time and is only
+// ever appended to. Every operation runs in an EBR section, and nodes
+// taken out of the list are freed through EBR, as a reader may still be
+// walking through them.
+typedef struct so_table_t {
+  so_node_t **segments[SO_LEVELS];
+  unsigned int buckets;       // buckets in use, a power of two
+} so_table_t;
+
+static inline unsigned int so_hash(int key)
+{
+  unsigned int h = (unsigned int)key;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static inline unsigned int so_reverse(unsigned int x)
+{
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  return __builtin_bswap32(x);
+}
+
+// A key sorts after its bucket's marker and before the next bucket's;
+// all 32 hash bits are kept, so distinct keys never share an order.
+static inline unsigned long long so_key_order(unsigned int h)
+{
+  return ((unsigned long long)so_reverse(h) << 1) | 1;
+}
+
+static inline unsigned long long so_bucket_order(unsigned int b)
+{
+  return (unsigned long long)so_reverse(b) << 1;
+}
+
+/**
+ * The directory slot of bucket b, allocating its segment if needed
+ * @return the slot, or NULL if the segment could not be allocated
+ */
+static so_node_t **so_slot(so_table_t *t, unsigned int b)
+{
+  int level = (b == 0) ? 0 : 32 - __builtin_clz(b);
+  unsigned int offset = (b == 0) ? 0 : b - (1u << (level - 1));
+  so_node_t **segment = __atomic_load_n(&t->segments[level], __ATOMIC_ACQUIRE);
+
+  if (segment == NULL)
+  {
+    so_node_t **fresh = calloc(level == 0 ? 1 : 1u << (level - 1), sizeof(so_node_t *));
+    if (fresh == NULL)
+      return NULL;
+    if (__atomic_compare_exchange_n(&t->segments[level], &segment, fresh, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      segment = fresh;
+    else
+      free(fresh); // Lost the race; segment now holds the winner's
+  }
+  return &segment[offset];
+}
+
+/**
+ * Returns the marker node of bucket b, inserting it (and its parent
+ * buckets' markers) the first time the bucket is used. If memory runs
+ * out, the parent's marker is returned instead; it precedes b's keys in
+ * the list, so searches stay correct, only longer.
+ */
+static so_node_t *so_bucket(so_table_t *t, unsigned int b)
+{
+  so_node_t **slot = so_slot(t, b);
+  so_node_t *marker = (slot != NULL) ? __atomic_load_n(slot, __ATOMIC_ACQUIRE) : NULL;
+  if (marker != NULL)
+    return marker;
+
+  // The parent bucket is b without its top bit: b split off from it
+  so_node_t *parent = so_bucket(t, b & ~(1u << (31 - __builtin_clz(b))));
+  if (slot == NULL || (marker = malloc(sizeof(so_node_t))) == NULL)
+    return parent;
+  marker->order = so_bucket_order(b);
+  marker->cell = 0;
+  marker->key = 0;
+
+  so_node_t **prev;
+  so_node_t *cur;
+  while (1)
+  {
+    if (ts_list_find(&parent->next, marker->order, &prev, &cur)) // Another thread got there first
+    {
+      free(marker);
+      marker = cur;
+      break;
+    }
+    marker->next = cur;
+    if (__atomic_compare_exchange_n(prev, &cur, marker, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      break;
+  }
+  __atomic_store_n(slot, marker, __ATOMIC_RELEASE);
+  return marker;
+}
+
+static int so_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  so_table_t *t = calloc(1, sizeof(so_table_t));
+  so_node_t *head = malloc(sizeof(so_node_t));
+  unsigned int buckets = 1;
+  while (buckets < SO_MAX_BUCKETS && buckets < (unsigned int)config->capacity)
+    buckets *= 2;
+
+  // Bucket 0's marker heads the list and is the root of every bucket
+  so_node_t **slot = (t != NULL && head != NULL) ? so_slot(t, 0) : NULL;
+  if (slot == NULL)
+  {
+    free(t);
+    free(head);
+    return -1;
+  }
+  head->order = so_bucket_order(0);
+  head->cell = 0;
+  head->next = NULL;
+  head->key = 0;
+  *slot = head;
+  t->buckets = buckets;
+
+  map->impl = t;
+  map->capacity = buckets;
+  return 0;
+}
+
+static int so_get(ts_hashmap_t *map, int key)
+{
+  so_table_t *t = map->impl;
+  unsigned int h = so_hash(key);
+  int walked = 0;
+  ts_ebr_enter();
+  so_node_t *start = so_bucket(t, h & (__atomic_load_n(&t->buckets, __ATOMIC_ACQUIRE) - 1));
+  int value = ts_list_get(&start->next, so_key_order(h), &walked);
+  ts_ebr_exit();
+  ts_count_get(map, value);
+  return value; // INT_MAX if not found
+}
+
+static int so_put(ts_hashmap_t *map, int key, int value)
+{
+  so_table_t *t = map->impl;
+  unsigned int h = so_hash(key);
+  int inserted = 0;
+  ts_ebr_enter();
+  so_node_t *start = so_bucket(t, h & (__atomic_load_n(&t->buckets, __ATOMIC_ACQUIRE) - 1));
+  int returnVal = ts_list_put(&start->next, so_key_order(h), key, value, &inserted);
+  ts_ebr_exit();
+
+  if (!inserted)
+  {
+    if (returnVal != TS_PUT_FAILED)
+      TS_COUNT(map, updates);
+    return returnVal;
+  }
+
+  // Doubling the directory is one CAS; new buckets fill in lazily
+  TS_COUNT(map, inserts);
+  unsigned int buckets = __atomic_load_n(&t->buckets, __ATOMIC_RELAXED);
+  if ((++insertsSinceCheck % TS_LOAD_CHECK) == 0 &&
+      ts_count_size(map) > (long)buckets * SO_LOAD &&
+      buckets < SO_MAX_BUCKETS &&
+      __atomic_compare_exchange_n(&t->buckets, &buckets, buckets * 2, 0,
+                                  __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    __atomic_store_n(&map->capacity, buckets * 2, __ATOMIC_RELAXED);
+  return INT_MAX;
+}
+
+static int so_del(ts_hashmap_t *map, int key)
+{
+  so_table_t *t = map->impl;
+  unsigned int h = so_hash(key);
+  int removed = 0;
+  ts_ebr_enter();
+  so_node_t *start = so_bucket(t, h & (__atomic_load_n(&t->buckets, __ATOMIC_ACQUIRE) - 1));
+  int returnVal = ts_list_del(&start->next, so_key_order(h), &removed);
+  ts_ebr_exit();
+
+  if (removed)
+    TS_COUNT(map, deletes);
+  else
+    TS_COUNT(map, delMisses);
+  return returnVal; // INT_MAX if not found
+}
+
+static void so_print(ts_hashmap_t *map)
+{
+  so_table_t *t = map->impl;
+  for (so_node_t *node = t->segments[0][0]; node != NULL; node = ts_list_unmarked(node->next))
+  {
+    if (!(node->order & 1))
+    {
+      if (node != t->segments[0][0])
+        printf("\n");
+      printf("[%u] -> ", so_reverse((unsigned int)(node->order >> 1)));
+    }
+    else if (!(node->cell & TS_LIST_REMOVED))
+    {
+      printf("(%d,%d) ", node->key, (int)(unsigned int)node->cell);
+    }
+  }
+  printf("\n");
+}
+
+static void so_free(ts_hashmap_t *map)
+{
+  so_table_t *t = map->impl;
+  so_node_t *node = t->segments[0][0];
+  while (node != NULL)
+  {
+    so_node_t *next = ts_list_unmarked(node->next);
+    free(node);
+    node = next;
+  }
+  for (int level = 0; level < SO_LEVELS; level++)
+    free(t->segments[level]);
+  free(t);
+}
+
+/**
+ * Probe length is the key's position among the keys following the
+ * nearest bucket marker. Reads without stopping writers, so under
+ * concurrent updates the numbers are approximate.
+ */
+static void so_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  so_table_t *t = map->impl;
+  long totalProbe = 0;
+  int entries = 0;
+  int probe = 0;
+
+  ts_ebr_enter();
+  for (so_node_t *node = t->segments[0][0]; node != NULL;
+       node = ts_list_unmarked(__atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+  {
+    if (!(node->order & 1))
+    {
+      probe = 0;
+      continue;
+    }
+    if (__atomic_load_n(&node->cell, __ATOMIC_ACQUIRE) & TS_LIST_REMOVED)
+      continue;
+    probe++;
+    totalProbe += probe;
+    entries++;
+    if (probe > stats->maxProbe)
+      stats->maxProbe = probe;
+  }
+  ts_ebr_exit();
+
+  if (entries > 0)
+    stats->meanProbe = (double)totalProbe / entries;
+  stats->retired = ts_ebr_pending();
+  stats->retiredBound = -1;
+}
+
+const ts_ops_t ts_splitorder_ops = {
+  .init = so_init,
+  .get = so_get,
+  .put = so_put,
+  .del = so_del,
+  .print = so_print,
+  .free = so_free,
+  .stats = so_stats,
+};
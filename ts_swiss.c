@@ -0,0 +1,510 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include "ts_backend.h"
+#include "ts_ebr.h"
+
+#define SW_EMPTY ((signed char)-128)   // control byte of a never-used slot
+#define SW_DELETED ((signed char)-2)   // control byte of a deleted slot
+#define SW_MAX_GROUP 32                // widest group any ISA compares at once
+#define SW_READ_TRIES 4                // optimistic attempts before get() takes the lock
+
+// A slot holds one key/value pair. Its control byte says whether it is
+// empty, deleted, or full; a full slot's byte is the low 7 bits of the
+// key's hash (its tag). Lookups compare the tag against a whole group of
+// control bytes with one SIMD instruction and only read the slots whose
+// tag matched. Slots are probed group by group, with triangular steps
+// over the power-of-two number of groups.
+typedef struct sw_slot_t {
+  int key;
+  int value;
+} sw_slot_t;
+
+// The control bytes, slots and their geometry, published together so
+// that a rehash swaps them in one store. Replaced ones are freed through
+// EBR.
+typedef struct sw_arrays_t {
+  signed char *ctrl;
+  sw_slot_t *slots;
+  unsigned int mask;       // number of slots - 1
+  unsigned int groupMask;  // number of groups - 1
+} sw_arrays_t;
+
+// One reader/writer lock serializes writers, as in the oa backend: a
+// probe sequence jumps between groups anywhere in the table, so no slot
+// range bounds what a writer touches. get() reads without it under
+// version, which writers make odd while they fill or free slots. Control
+// bytes change only through whole 8-byte atomic words, which get() copies
+// a group of before matching, so SIMD never compares a torn byte.
+typedef struct sw_table_t {
+  sw_arrays_t *arrays;
+  unsigned int version;
+  int used;
+  int growthLeft;          // empty slots we may still fill before rehashing
+  pthread_rwlock_t lock;
+} sw_table_t;
+
+// Group width and matchers, chosen once from CPUID
+static int groupWidth;
+static unsigned int (*matchTag)(const signed char *, signed char);
+static unsigned int (*matchFree)(const signed char *);
+static pthread_once_t isaOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Bit i set for each control byte of the group equal to tag
+ */
+static unsigned int scalar_match_tag(const signed char *group, signed char tag)
+{
+  unsigned int mask = 0;
+  for (int i = 0; i < 16; i++)
+    mask |= (unsigned int)(group[i] == tag) << i;
+  return mask;
+}
+
+/**
+ * Bit i set for each empty or deleted control byte of the group
+ */
+static unsigned int scalar_match_free(const signed char *group)
+{
+  unsigned int mask = 0;
+  for (int i = 0; i < 16; i++)
+    mask |= (unsigned int)(group[i] < 0) << i;
+  return mask;
+}
+
+#ifdef __SSE2__
+static unsigned int sse2_match_tag(const signed char *group, signed char tag)
+{
+  __m128i ctrl = _mm_load_si128((const __m128i *)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+}
+
+// Empty and deleted bytes are the ones with the sign bit set
+static unsigned int sse2_match_free(const signed char *group)
+{
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i *)group));
+}
+
+__attribute__((target("avx2")))
+static unsigned int avx2_match_tag(const signed char *group, signed char tag)
+{
+  __m256i ctrl = _mm256_load_si256((const __m256i *)group);
+  return (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8(tag)));
+}
+
+__attribute__((target("avx2")))
+static unsigned int avx2_match_free(const signed char *group)
+{
+  return (unsigned int)_mm256_movemask_epi8(_mm256_load_si256((const __m256i *)group));
+}
+#endif
+
+/**
+ * Picks 32-byte AVX2 groups when the CPU has them, 16-byte SSE2 groups
+ * otherwise, and a scalar loop on targets without SSE2.
+ */
+static void sw_select_isa(void)
+{
+  groupWidth = 16;
+  matchTag = scalar_match_tag;
+  matchFree = scalar_match_free;
+#ifdef __SSE2__
+  matchTag = sse2_match_tag;
+  matchFree = sse2_match_free;
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    groupWidth = 32;
+    matchTag = avx2_match_tag;
+    matchFree = avx2_match_free;
+  }
+#endif
+}
+
+/**
+ * Mixes the key (murmur3 finalizer): the top bits pick the home group,
+ * the low 7 bits are the tag
+ */
+static inline unsigned int sw_hash(int key)
+{
+  unsigned int h = (unsigned int)key;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static inline unsigned int sw_home(const sw_arrays_t *a, unsigned int hash)
+{
+  return (hash >> 7) & a->groupMask;
+}
+
+static void sw_free_arrays(void *p)
+{
+  sw_arrays_t *a = p;
+  free(a->ctrl);
+  free(a->slots);
+  free(a);
+}
+
+/**
+ * Allocates empty control bytes and slots for the given number of slots
+ * @return the arrays, or NULL on allocation failure
+ */
+static sw_arrays_t *sw_alloc_arrays(unsigned int slots)
+{
+  sw_arrays_t *a = malloc(sizeof(sw_arrays_t));
+  if (a == NULL)
+    return NULL;
+  a->ctrl = aligned_alloc(SW_MAX_GROUP, slots);
+  a->slots = aligned_alloc(64, ((size_t)slots * sizeof(sw_slot_t) + 63) & ~(size_t)63);
+  if (a->ctrl == NULL || a->slots == NULL)
+  {
+    sw_free_arrays(a);
+    return NULL;
+  }
+  memset(a->ctrl, SW_EMPTY, slots);
+  a->mask = slots - 1;
+  a->groupMask = slots / groupWidth - 1;
+  return a;
+}
+
+/**
+ * Sets the control byte of slot i by storing the whole 8-byte word it is
+ * in. Caller holds the write lock, so no other byte of the word changes.
+ */
+static inline void sw_set_ctrl(sw_arrays_t *a, unsigned int i, signed char c)
+{
+  unsigned long long *word = (unsigned long long *)(a->ctrl + (i & ~7u));
+  unsigned long long w = __atomic_load_n(word, __ATOMIC_RELAXED);
+  ((signed char *)&w)[i & 7] = c;
+  __atomic_store_n(word, w, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copies the control bytes of group g into copy a word at a time
+ * @return copy, ready for matchTag()
+ */
+static inline const signed char *sw_group(const sw_arrays_t *a, unsigned int g, unsigned long long *copy)
+{
+  const unsigned long long *words = (const unsigned long long *)(a->ctrl + (size_t)g * groupWidth);
+  for (int w = 0; w < groupWidth / 8; w++)
+    copy[w] = __atomic_load_n(&words[w], __ATOMIC_RELAXED);
+  return (const signed char *)copy;
+}
+
+/**
+ * Finds the slot holding key. A reader racing a writer may see no empty
+ * byte anywhere; it gives up after visiting every group once.
+ * @return the slot, or -1 if the key is not stored
+ */
+static long sw_find(const sw_arrays_t *a, int key, unsigned int hash)
+{
+  unsigned long long copy[SW_MAX_GROUP / 8] __attribute__((aligned(SW_MAX_GROUP)));
+  signed char tag = hash & 0x7F;
+  unsigned int g = sw_home(a, hash);
+
+  for (unsigned int step = 1; step <= a->groupMask + 1; step++)
+  {
+    const signed char *group = sw_group(a, g, copy);
+    unsigned int match = matchTag(group, tag);
+    while (match != 0)
+    {
+      unsigned int i = g * groupWidth + __builtin_ctz(match);
+      if (__atomic_load_n(&a->slots[i].key, __ATOMIC_RELAXED) == key)
+        return i;
+      match &= match - 1;
+    }
+    if (matchTag(group, SW_EMPTY) != 0) // The key would have stopped here
+      return -1;
+    g = (g + step) & a->groupMask;
+  }
+  return -1;
+}
+
+/**
+ * First empty or deleted slot on the probe sequence of hash. Caller holds
+ * the write lock.
+ */
+static unsigned int sw_find_free(const sw_arrays_t *a, unsigned int hash)
+{
+  unsigned int g = sw_home(a, hash);
+  for (unsigned int step = 1; ; step++)
+  {
+    unsigned int match = matchFree(a->ctrl + (size_t)g * groupWidth);
+    if (match != 0)
+      return g * groupWidth + __builtin_ctz(match);
+    g = (g + step) & a->groupMask;
+  }
+}
+
+/**
+ * Stores a key that is not in the table into a free slot
+ */
+static void sw_place(sw_table_t *t, sw_arrays_t *a, int key, int value, unsigned int hash)
+{
+  unsigned int i = sw_find_free(a, hash);
+  if (a->ctrl[i] == SW_EMPTY)
+    t->growthLeft--;
+  __atomic_store_n(&a->slots[i].key, key, __ATOMIC_RELAXED);
+  __atomic_store_n(&a->slots[i].value, value, __ATOMIC_RELAXED);
+  sw_set_ctrl(a, i, hash & 0x7F);
+}
+
+/**
+ * Marks the start of a change that optimistic readers must not see half
+ * done. Caller holds the write lock.
+ */
+static inline void sw_write_begin(sw_table_t *t)
+{
+  __atomic_store_n(&t->version, t->version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void sw_write_end(sw_table_t *t)
+{
+  __atomic_store_n(&t->version, t->version + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Rebuilds the table without tombstones, doubling it unless that alone
+ * frees enough room. The new arrays are published once full and the old
+ * ones retired, as readers may still be on them. Caller holds the write
+ * lock.
+ * @return 0 on success, -1 on allocation failure (the table is unchanged)
+ */
+static int sw_rehash(sw_table_t *t)
+{
+  sw_arrays_t *old = t->arrays;
+  unsigned int slots = old->mask + 1;
+
+  if ((unsigned int)t->used >= slots / 2 - slots / 16)
+    slots *= 2;
+  sw_arrays_t *a = sw_alloc_arrays(slots);
+  if (a == NULL)
+    return -1;
+
+  t->growthLeft = slots - slots / 8;   // rehash beyond 7/8 full
+  for (unsigned int i = 0; i <= old->mask; i++)
+  {
+    if (old->ctrl[i] >= 0)
+      sw_place(t, a, old->slots[i].key, old->slots[i].value, sw_hash(old->slots[i].key));
+  }
+  __atomic_store_n(&t->arrays, a, __ATOMIC_RELEASE);
+  ts_ebr_retire(old, sw_free_arrays);
+  return 0;
+}
+
+static int sw_init(ts_hashmap_t *map, const ts_config_t *config)
+{
+  pthread_once(&isaOnce, sw_select_isa);
+
+  sw_table_t *t = malloc(sizeof(sw_table_t));
+  unsigned int slots = groupWidth;
+  while (slots < (1u << 30) && slots < (unsigned int)config->capacity)
+    slots *= 2;
+
+  if (t == NULL || (t->arrays = sw_alloc_arrays(slots)) == NULL)
+  {
+    free(t);
+    return -1;
+  }
+  t->version = 0;
+  t->used = 0;
+  t->growthLeft = slots - slots / 8;
+  pthread_rwlock_init(&t->lock, NULL);
+
+  map->impl = t;
+  map->capacity = slots;
+  return 0;
+}
+
+/**
+ * Looks key up without the lock, inside an EBR section
+ * @param value where to store the value, or INT_MAX if key was not found
+ * @return 1 if the read validated, 0 if a writer got in the way
+ */
+static int sw_get_optimistic(sw_table_t *t, int key, unsigned int hash, int *value)
+{
+  unsigned int before = __atomic_load_n(&t->version, __ATOMIC_ACQUIRE);
+  if (before & 1)
+    return 0;
+
+  sw_arrays_t *a = __atomic_load_n(&t->arrays, __ATOMIC_ACQUIRE);
+  long i = sw_find(a, key, hash);
+  *value = (i >= 0) ? __atomic_load_n(&a->slots[i].value, __ATOMIC_RELAXED) : INT_MAX;
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&t->version, __ATOMIC_RELAXED) == before;
+}
+
+static int sw_get(ts_hashmap_t *map, int key)
+{
+  sw_table_t *t = map->impl;
+  unsigned int hash = sw_hash(key);
+  int returnVal = INT_MAX;
+  int done = 0;
+
+  ts_ebr_enter();
+  for (int attempt = 0; attempt < SW_READ_TRIES && !done; attempt++)
+    done = sw_get_optimistic(t, key, hash, &returnVal);
+  ts_ebr_exit();
+
+  if (!done) // Too much churn: wait for the writers instead
+  {
+    pthread_rwlock_rdlock(&t->lock);
+    long i = sw_find(t->arrays, key, hash);
+    returnVal = (i >= 0) ? t->arrays->slots[i].value : INT_MAX;
+    pthread_rwlock_unlock(&t->lock);
+  }
+  ts_count_get(map, returnVal);
+  return returnVal;
+}
+
+static int sw_put(ts_hashmap_t *map, int key, int value)
+{
+  sw_table_t *t = map->impl;
+  unsigned int hash = sw_hash(key);
+  int returnVal = INT_MAX;
+
+  pthread_rwlock_wrlock(&t->lock);
+  sw_arrays_t *a = t->arrays;
+  long i = sw_find(a, key, hash);
+  if (i >= 0) // Key exists, replace the value; one store, so no version change
+  {
+    returnVal = a->slots[i].value;
+    __atomic_store_n(&a->slots[i].value, value, __ATOMIC_RELAXED);
+  }
+  else
+  {
+    // Reusing a tombstone costs no growth; only rehash when we would
+    // have to fill one of the last empty slots. If that fails, the key
+    // is turned away rather than eat into the empty slots probes end on.
+    unsigned int slot = sw_find_free(a, hash);
+    int full = a->ctrl[slot] == SW_EMPTY && t->growthLeft == 0;
+    sw_write_begin(t);
+    if (full && sw_rehash(t) == 0)
+    {
+      a = t->arrays;
+      map->capacity = a->mask + 1;
+      full = 0;
+    }
+    if (full)
+    {
+      returnVal = TS_PUT_FAILED;
+    }
+    else
+    {
+      sw_place(t, a, key, value, hash);
+      t->used++;
+    }
+    sw_write_end(t);
+  }
+  pthread_rwlock_unlock(&t->lock);
+  if (i >= 0)
+    TS_COUNT(map, updates);
+  else if (returnVal != TS_PUT_FAILED)
+    TS_COUNT(map, inserts);
+  return returnVal;
+}
+
+static int sw_del(ts_hashmap_t *map, int key)
+{
+  sw_table_t *t = map->impl;
+  int returnVal = INT_MAX;
+
+  pthread_rwlock_wrlock(&t->lock);
+  sw_arrays_t *a = t->arrays;
+  long i = sw_find(a, key, sw_hash(key));
+  if (i >= 0)
+  {
+    returnVal = a->slots[i].value;
+
+    // A group that still has an empty byte never filled up, so no probe
+    // ever passed through it and the slot can go straight back to empty
+    const signed char *group = a->ctrl + (i & ~(long)(groupWidth - 1));
+    sw_write_begin(t);
+    if (matchTag(group, SW_EMPTY) != 0)
+    {
+      sw_set_ctrl(a, i, SW_EMPTY);
+      t->growthLeft++;
+    }
+    else
+    {
+      sw_set_ctrl(a, i, SW_DELETED);
+    }
+    sw_write_end(t);
+    t->used--;
+  }
+  pthread_rwlock_unlock(&t->lock);
+  if (i >= 0)
+    TS_COUNT(map, deletes);
+  else
+    TS_COUNT(map, delMisses);
+  return returnVal;
+}
+
+static void sw_print(ts_hashmap_t *map)
+{
+  sw_arrays_t *a = ((sw_table_t *)map->impl)->arrays;
+  for (unsigned int i = 0; i <= a->mask; i++)
+  {
+    printf("[%u] -> ", i);
+    if (a->ctrl[i] >= 0)
+      printf("(%d,%d)", a->slots[i].key, a->slots[i].value);
+    printf("\n");
+  }
+}
+
+static void sw_free(ts_hashmap_t *map)
+{
+  sw_table_t *t = map->impl;
+  pthread_rwlock_destroy(&t->lock);
+  sw_free_arrays(t->arrays);
+  free(t);
+}
+
+/**
+ * Probe lengths here count groups, not slots: a key in its home group
+ * has probe length 1.
+ */
+static void sw_stats(ts_hashmap_t *map, ts_stats_t *stats)
+{
+  sw_table_t *t = map->impl;
+  long totalProbe = 0;
+
+  pthread_rwlock_rdlock(&t->lock);
+  sw_arrays_t *a = t->arrays;
+  for (unsigned int i = 0; i <= a->mask; i++)
+  {
+    if (a->ctrl[i] < 0)
+      continue;
+    unsigned int g = sw_home(a, sw_hash(a->slots[i].key));
+    int probe = 1;
+    for (unsigned int step = 1; g != i / groupWidth; step++, probe++)
+      g = (g + step) & a->groupMask;
+    totalProbe += probe;
+    if (probe > stats->maxProbe)
+      stats->maxProbe = probe;
+  }
+  if (t->used > 0)
+    stats->meanProbe = (double)totalProbe / t->used;
+  pthread_rwlock_unlock(&t->lock);
+}
+
+const ts_ops_t ts_swiss_ops = {
+  .init = sw_init,
+  .get = sw_get,
+  .put = sw_put,
+  .del = sw_del,
+  .print = sw_print,
+  .free = sw_free,
+  .stats = sw_stats,
+};
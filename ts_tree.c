@@ -0,0 +1,239 @@
+#include <stddef.h>
+#include "ts_tree.h"
+
+// Sedgewick's left-leaning red-black tree: a 2-3 tree whose 3-nodes are
+// pairs of nodes joined by a red left link. Insert and remove go down
+// recursively and restore the shape on the way back up, so neither needs
+// parent pointers.
+
+static inline int is_red(ts_tree_node_t *h)
+{
+  return h != NULL && h->red;
+}
+
+static inline void set_left(ts_tree_node_t *h, ts_tree_node_t *x)
+{
+  __atomic_store_n(&h->left, x, __ATOMIC_RELEASE);
+}
+
+static inline void set_right(ts_tree_node_t *h, ts_tree_node_t *x)
+{
+  __atomic_store_n(&h->right, x, __ATOMIC_RELEASE);
+}
+
+static ts_tree_node_t *rotate_left(ts_tree_node_t *h)
+{
+  ts_tree_node_t *x = h->right;
+  set_right(h, x->left);
+  set_left(x, h);
+  x->red = h->red;
+  h->red = 1;
+  return x;
+}
+
+static ts_tree_node_t *rotate_right(ts_tree_node_t *h)
+{
+  ts_tree_node_t *x = h->left;
+  set_left(h, x->right);
+  set_right(x, h);
+  x->red = h->red;
+  h->red = 1;
+  return x;
+}
+
+static void flip_colors(ts_tree_node_t *h)
+{
+  h->red = !h->red;
+  h->left->red = !h->left->red;
+  h->right->red = !h->right->red;
+}
+
+/**
+ * Restores the left-leaning shape at h on the way back up
+ * @return the subtree's new root
+ */
+static ts_tree_node_t *fix_up(ts_tree_node_t *h)
+{
+  if (is_red(h->right) && !is_red(h->left))
+    h = rotate_left(h);
+  if (is_red(h->left) && is_red(h->left->left))
+    h = rotate_right(h);
+  if (is_red(h->left) && is_red(h->right))
+    flip_colors(h);
+  return h;
+}
+
+/**
+ * Finds the node holding key. For writers; readers without the lock
+ * walk the tree themselves.
+ * @param walked where to store the number of nodes examined; may be NULL
+ * @return the node, or NULL if key is not in the tree
+ */
+ts_tree_node_t *ts_tree_find(ts_tree_t *tree, int key, int *walked)
+{
+  ts_tree_node_t *h = tree->root;
+  int steps = 0;
+  while (h != NULL)
+  {
+    steps++;
+    if (key == h->key)
+      break;
+    h = (key < h->key) ? h->left : h->right;
+  }
+  if (walked != NULL)
+    *walked = steps;
+  return h;
+}
+
+static ts_tree_node_t *insert_under(ts_tree_node_t *h, ts_tree_node_t *node)
+{
+  if (h == NULL)
+    return node;
+  if (node->key < h->key)
+    set_left(h, insert_under(h->left, node));
+  else
+    set_right(h, insert_under(h->right, node));
+  return fix_up(h);
+}
+
+/**
+ * Links node, whose key the tree does not hold yet, into the tree. The
+ * caller fills in key and value, or hands over a node walked off another
+ * tree, which readers of that one may still be going down.
+ */
+void ts_tree_insert(ts_tree_t *tree, ts_tree_node_t *node)
+{
+  set_left(node, NULL);
+  set_right(node, NULL);
+  node->red = 1;
+  ts_tree_node_t *root = insert_under(tree->root, node);
+  root->red = 0;
+  __atomic_store_n(&tree->root, root, __ATOMIC_RELEASE);
+  tree->count++;
+}
+
+/**
+ * Makes h or its left child red when removal goes down to the left
+ * through a 2-node
+ */
+static ts_tree_node_t *move_red_left(ts_tree_node_t *h)
+{
+  flip_colors(h);
+  if (is_red(h->right->left))
+  {
+    set_right(h, rotate_right(h->right));
+    h = rotate_left(h);
+    flip_colors(h);
+  }
+  return h;
+}
+
+static ts_tree_node_t *move_red_right(ts_tree_node_t *h)
+{
+  flip_colors(h);
+  if (is_red(h->left->left))
+  {
+    h = rotate_right(h);
+    flip_colors(h);
+  }
+  return h;
+}
+
+/**
+ * Unlinks the smallest node under h
+ * @param min where to store it
+ * @return the subtree's new root
+ */
+static ts_tree_node_t *remove_min(ts_tree_node_t *h, ts_tree_node_t **min)
+{
+  if (h->left == NULL) // A leaf, as nothing leans right
+  {
+    *min = h;
+    return NULL;
+  }
+  if (!is_red(h->left) && !is_red(h->left->left))
+    h = move_red_left(h);
+  set_left(h, remove_min(h->left, min));
+  return fix_up(h);
+}
+
+static ts_tree_node_t *remove_under(ts_tree_node_t *h, int key, ts_tree_node_t **removed)
+{
+  if (key < h->key)
+  {
+    if (!is_red(h->left) && !is_red(h->left->left))
+      h = move_red_left(h);
+    set_left(h, remove_under(h->left, key, removed));
+    return fix_up(h);
+  }
+
+  if (is_red(h->left))
+    h = rotate_right(h);
+  if (key == h->key && h->right == NULL)
+  {
+    *removed = h;
+    return NULL;
+  }
+  if (!is_red(h->right) && !is_red(h->right->left))
+    h = move_red_right(h);
+  if (key == h->key)
+  {
+    // Put the successor node in h's place rather than copy its pair over
+    // h's, so that a node never changes key under a reader
+    ts_tree_node_t *min;
+    ts_tree_node_t *right = remove_min(h->right, &min);
+    min->red = h->red;
+    set_left(min, h->left);
+    set_right(min, right);
+    *removed = h;
+    h = min;
+  }
+  else
+  {
+    set_right(h, remove_under(h->right, key, removed));
+  }
+  return fix_up(h);
+}
+
+/**
+ * Unlinks the node holding key
+ * @return the node, or NULL if key is not in the tree
+ */
+ts_tree_node_t *ts_tree_remove(ts_tree_t *tree, int key)
+{
+  ts_tree_node_t *removed = NULL;
+  if (ts_tree_find(tree, key, NULL) == NULL)
+    return NULL;
+
+  ts_tree_node_t *root = tree->root;
+  if (!is_red(root->left) && !is_red(root->right))
+    root->red = 1;
+  root = remove_under(root, key, &removed);
+  if (root != NULL)
+    root->red = 0;
+  __atomic_store_n(&tree->root, root, __ATOMIC_RELEASE);
+  tree->count--;
+  return removed;
+}
+
+static void walk_under(ts_tree_node_t *h, int depth, void (*visit)(ts_tree_node_t *, int, void *), void *arg)
+{
+  while (h != NULL)
+  {
+    walk_under(h->left, depth + 1, visit, arg);
+    ts_tree_node_t *right = h->right; // visit may free h
+    visit(h, depth, arg);
+    h = right;
+    depth++;
+  }
+}
+
+/**
+ * Calls visit on every node in key order, with the number of nodes from
+ * the root down to it, itself included. visit may free the node it is
+ * given, as the walk is done with it by then.
+ */
+void ts_tree_walk(ts_tree_t *tree, void (*visit)(ts_tree_node_t *, int, void *), void *arg)
+{
+  walk_under(tree->root, 1, visit, arg);
+}
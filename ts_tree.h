@@ -0,0 +1,34 @@
+#ifndef TS_TREE_H_
+#define TS_TREE_H_
+
+// Left-leaning red-black trees of key/value nodes, which the chained
+// table puts in place of chains that grow too long, so that a bucket
+// costs O(log n) at worst however many keys land in it. The tree never
+// allocates or frees: callers hand in the nodes to link and get back the
+// nodes unlinked, and free them however their readers need.
+//
+// Writers hold whatever lock guards the tree. They store links with
+// release semantics, so a reader without the lock that loads them with
+// acquire always reaches initialized nodes. Rotations move nodes around
+// under such a reader, so what it finds is only good if it can tell
+// afterwards that no writer ran meanwhile.
+
+typedef struct ts_tree_node_t {
+   int key;
+   int value;
+   struct ts_tree_node_t *left;
+   struct ts_tree_node_t *right;
+   int red;                      // the link from the parent is red
+} ts_tree_node_t;
+
+typedef struct ts_tree_t {
+   ts_tree_node_t *root;
+   int count;
+} ts_tree_t;
+
+ts_tree_node_t *ts_tree_find(ts_tree_t*, int, int*);
+void ts_tree_insert(ts_tree_t*, ts_tree_node_t*);
+ts_tree_node_t *ts_tree_remove(ts_tree_t*, int);
+void ts_tree_walk(ts_tree_t*, void (*)(ts_tree_node_t*, int, void*), void*);
+
+#endif /* TS_TREE_H_ */